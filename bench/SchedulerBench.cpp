@@ -0,0 +1,149 @@
+/*
+  Simple co-routine library for Arduino.
+
+  Copyright 2011-2017 Martin Gamwell Dawids.
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+  Scheduler benchmark (host builds only)
+  --------------------------------------
+  Measures the cost of the scheduler itself with 10k, 100k and 1M
+  co-routines whose workers do nothing. Time is simulated, so every run
+  is one millisecond after the last one.
+
+    busy tick   All co-routines have a period of 1 s, staggered, so each
+                run invokes n / 1000 workers. Time per run including
+                'getNextWakeup()'.
+    idle tick   All co-routines wait for an hour. Time per run including
+                'getNextWakeup()'.
+    add         Time per 'addCoRoutine()' into an empty scheduler.
+    remove      Time per 'removeCoRoutine()' until the scheduler is empty.
+
+  Build and run with 'make' in this directory.
+ */
+
+#include <CoRoutines.h>
+#include <stdio.h>
+#include <time.h>
+
+using namespace coroutines;
+
+// A clock advanced by the benchmark.
+class BenchClock : public Clock
+{
+public:
+  unsigned long time;
+
+  BenchClock() : time(1000) { }
+
+  virtual unsigned long now()
+  {
+    return time;
+  }
+};
+
+// A co-routine doing nothing but waiting 'wait' milliseconds.
+class Idle : public CoRoutine
+{
+public:
+  int wait;
+
+  Idle() : wait(1000) { }
+
+protected:
+  virtual int worker()
+  {
+    return wait;
+  }
+};
+
+static BenchClock benchClock;
+
+// Returns the time of the system's monotonic clock in microseconds.
+static double systemMicros()
+{
+  timespec time;
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return time.tv_sec * 1e6 + time.tv_nsec / 1e3;
+}
+
+// Returns the mean time in microseconds of 'runs' runs of 'scheduler'.
+static double timeRuns(Scheduler& scheduler, unsigned int runs)
+{
+  const double start = systemMicros();
+  unsigned long wakeups = 0;
+  for (unsigned int i = 0; i != runs; ++i)
+  {
+    ++benchClock.time;
+    scheduler.runOnce();
+    wakeups += scheduler.getNextWakeup();
+  }
+  const double time = systemMicros() - start;
+
+  // Keep the calls of 'getNextWakeup()' from being optimized away.
+  if (wakeups == 0)
+  {
+    printf("?");
+  }
+  return time / runs;
+}
+
+static void bench(size_t count)
+{
+  Idle* const coRoutines = new Idle[count];
+  Scheduler scheduler;
+
+  double start = systemMicros();
+  for (size_t i = 0; i != count; ++i)
+  {
+    coRoutines[i].setPeriod(1000);
+    scheduler.addCoRoutine(coRoutines[i]);
+  }
+  const double add = (systemMicros() - start) * 1000 / count;
+
+  // Busy: n / 1000 co-routines due per millisecond.
+  scheduler.staggerPhases();
+  timeRuns(scheduler, 1000);
+  const double busy = timeRuns(scheduler, 2000);
+  const float work = scheduler.getMeanTickWork();
+
+  // Idle: nothing due for an hour after one more round.
+  for (size_t i = 0; i != count; ++i)
+  {
+    coRoutines[i].wait = 3600000;
+  }
+  timeRuns(scheduler, 1000);
+  const double idle = timeRuns(scheduler, 2000);
+
+  start = systemMicros();
+  for (size_t i = 0; i != count; ++i)
+  {
+    scheduler.removeCoRoutine(coRoutines[count - 1 - i]);
+  }
+  const double remove = (systemMicros() - start) * 1000 / count;
+
+  printf("%8lu  %10.2f us (%4.0f workers)  %8.2f us  %8.0f ns  %8.0f ns\n",
+         (unsigned long) count, busy, work, idle, add, remove);
+  delete[] coRoutines;
+}
+
+int main()
+{
+  setClock(&benchClock);
+  printf("%8s  %-28s  %11s  %11s  %11s\n", "tasks", "busy tick", "idle tick", "add", "remove");
+  bench(10000);
+  bench(100000);
+  bench(1000000);
+  setClock(0);
+  return 0;
+}
@@ -0,0 +1,63 @@
+/*
+  Blink
+
+  Blinks the built-in LED and prints the uptime every two seconds, each
+  from a co-routine of its own. Between runs of the scheduler the sketch
+  sleeps until the next co-routine is due.
+ */
+
+#include <CoRoutines.h>
+
+using namespace coroutines;
+
+// Toggles the LED every half second.
+class Blinker : public CoRoutine
+{
+private:
+  bool on;
+
+protected:
+  virtual int worker()
+  {
+    on = !on;
+    digitalWrite(LED_BUILTIN, on ? HIGH : LOW);
+    return 500;
+  }
+
+public:
+  Blinker() : on(false) { }
+};
+
+// Prints the uptime every two seconds.
+class Reporter : public CoRoutine
+{
+protected:
+  virtual int worker()
+  {
+    Serial.print("Up for ");
+    Serial.print(millis() / 1000);
+    Serial.println(" s");
+    return 2000;
+  }
+};
+
+Scheduler scheduler;
+Blinker blinker;
+Reporter reporter;
+
+void setup()
+{
+  pinMode(LED_BUILTIN, OUTPUT);
+  Serial.begin(9600);
+  scheduler.addCoRoutine(blinker);
+  scheduler.addCoRoutine(reporter);
+}
+
+void loop()
+{
+  scheduler.runOnce();
+
+  // Sleep until the next co-routine is due, but let 'loop()' return at
+  // least every 100 ms.
+  delay(scheduler.getTimeToNextWakeup(100));
+}
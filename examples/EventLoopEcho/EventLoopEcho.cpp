@@ -0,0 +1,145 @@
+/*
+  EventLoopEcho (Linux host builds only)
+
+  Echoes each line read from standard input in upper case. The reader
+  sleeps in an EventLoop until input arrives, and the conversion, which
+  pretends to be slow, is offloaded to an OffloadPool. Meanwhile another
+  thread awakes a ticker co-routine once a second through the
+  ConcurrentScheduler run by the loop. End the input to stop.
+
+    echo hello | ./EventLoopEcho
+ */
+
+#include <ConcurrentScheduler.h>
+#include <EventLoop.h>
+#include <OffloadPool.h>
+#include <atomic>
+#include <chrono>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <thread>
+#include <unistd.h>
+
+using namespace coroutines;
+
+// A line being converted.
+struct Line
+{
+  char text[256];
+  size_t length;
+};
+
+// Converts a line to upper case, slowly.
+static void convert(void* argument)
+{
+  Line* line = (Line*) argument;
+  std::this_thread::sleep_for(std::chrono::milliseconds(200));
+  for (size_t i = 0; i != line->length; ++i)
+  {
+    line->text[i] = (char) toupper((unsigned char) line->text[i]);
+  }
+}
+
+// Reads standard input and echoes it once converted.
+class Echo : public CoRoutine
+{
+private:
+  EventLoop& loop;
+  OffloadPool& pool;
+  Line line;
+  bool converting;
+
+protected:
+  virtual int worker()
+  {
+    if (converting)
+    {
+      fwrite(line.text, 1, line.length, stdout);
+      fflush(stdout);
+      converting = false;
+    }
+    const ssize_t n = read(STDIN_FILENO, line.text, sizeof(line.text));
+    if (n > 0)
+    {
+      line.length = (size_t) n;
+      if (!pool.offload(*this, convert, &line))
+      {
+        fwrite(line.text, 1, line.length, stdout);
+        return 0;
+      }
+      converting = true;
+      return -1;
+    }
+    if (n < 0 && errno == EAGAIN)
+    {
+      loop.waitReadable(STDIN_FILENO, *this);
+      return -1;
+    }
+
+    // End of input.
+    loop.cancelWait(STDIN_FILENO);
+    loop.stop();
+    return -1;
+  }
+
+public:
+  Echo(EventLoop& loop, OffloadPool& pool) : loop(loop), pool(pool), converting(false) { }
+};
+
+// Prints a tick each time it is awakened.
+class Ticker : public CoRoutine
+{
+private:
+  int ticks;
+
+protected:
+  virtual int worker()
+  {
+    if (ticks != 0)
+    {
+      fprintf(stderr, "tick %d\n", ticks);
+    }
+    ++ticks;
+    return -1;
+  }
+
+public:
+  Ticker() : ticks(0) { }
+};
+
+int main()
+{
+  fcntl(STDIN_FILENO, F_SETFL, fcntl(STDIN_FILENO, F_GETFL) | O_NONBLOCK);
+
+  ConcurrentScheduler scheduler;
+  EventLoop loop(scheduler);
+  if (!loop.isValid())
+  {
+    perror("EventLoop");
+    return 1;
+  }
+  OffloadPool pool(loop, 1, 4);
+  scheduler.addCoRoutine(pool);
+  Echo echo(loop, pool);
+  scheduler.addCoRoutine(echo);
+  Ticker ticker;
+  scheduler.addCoRoutine(ticker);
+
+  std::atomic<bool> stopping(false);
+  std::thread clock([&]
+  {
+    while (!stopping.load())
+    {
+      std::this_thread::sleep_for(std::chrono::seconds(1));
+      scheduler.awakeConcurrently(ticker);
+    }
+  });
+
+  loop.run();
+  stopping.store(true);
+  clock.join();
+  return 0;
+}
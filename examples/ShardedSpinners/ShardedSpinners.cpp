@@ -0,0 +1,66 @@
+/*
+  ShardedSpinners (host builds only)
+
+  Runs two heavy and six light co-routines on a ShardedScheduler with two
+  shards. Both heavy co-routines start on the same shard; calling
+  'rebalance()' every 100 ms moves one of them to the other shard.
+ */
+
+#include <ShardedScheduler.h>
+#include <chrono>
+#include <stdio.h>
+#include <thread>
+
+using namespace coroutines;
+
+// Spins for 'spin' microseconds every millisecond.
+class Spinner : public CoRoutine
+{
+private:
+  const int spin;
+
+protected:
+  virtual int worker()
+  {
+    const std::chrono::steady_clock::time_point end =
+      std::chrono::steady_clock::now() + std::chrono::microseconds(spin);
+    while (std::chrono::steady_clock::now() < end)
+    {
+    }
+    return 1;
+  }
+
+public:
+  Spinner(int spin = 10) : spin(spin) { }
+};
+
+int main()
+{
+  ShardedScheduler scheduler(2, 16);
+  Spinner heavy1(400);
+  Spinner heavy2(400);
+  Spinner light[6];
+
+  scheduler.addCoRoutine(heavy1);
+  scheduler.addCoRoutine(light[0]);
+  scheduler.addCoRoutine(heavy2);
+  for (int i = 1; i != 6; ++i)
+  {
+    scheduler.addCoRoutine(light[i]);
+  }
+  printf("heavy co-routines on shards %d and %d\n",
+         scheduler.getShard(heavy1), scheduler.getShard(heavy2));
+
+  scheduler.start();
+  for (int i = 0; i != 10; ++i)
+  {
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    scheduler.rebalance();
+  }
+  scheduler.stop();
+
+  printf("heavy co-routines on shards %d and %d after %lu migrations\n",
+         scheduler.getShard(heavy1), scheduler.getShard(heavy2),
+         scheduler.getMigrationCount());
+  return 0;
+}
@@ -32,7 +32,10 @@
 
 #include <CoRoutines.h>
 
-#if defined(ARDUINO) && ARDUINO >= 100
+#if defined(CoRoutinesHost)
+  #include <string.h>
+  #include <time.h>
+#elif defined(ARDUINO) && ARDUINO >= 100
   #include "Arduino.h"
 #else
   #include "WProgram.h"
@@ -40,51 +43,283 @@
 
 namespace coroutines {
 
+#ifdef CoRoutinesHost
+  static Clock* clock = 0;
+
+  Clock::~Clock()
+  { }
+
+  void Clock::workerRan(CoRoutine&, unsigned long)
+  { }
+
+  void setClock(Clock* clock)
+  {
+    coroutines::clock = clock;
+  }
+
+  static unsigned long long monotonicMillis()
+  {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+  }
+
+  unsigned long currentTime()
+  {
+    if (clock != 0)
+    {
+      return clock->now();
+    }
+    
+    // Milliseconds since the first call, like 'millis()' on Arduino.
+    // (The start is initialised once even if called by several threads.)
+    static const unsigned long long start = monotonicMillis();
+    return (unsigned long) (monotonicMillis() - start);
+  }
+#else
+  unsigned long currentTime()
+  {
+    return millis();
+  }
+#endif
+
+  Next::Next(Kind kind, unsigned long time)
+    : kind(kind),
+      time(time)
+  { }
+
+  Next Next::after(unsigned long waitTime)
+  {
+    return Next(kindAfter, waitTime);
+  }
+
+  Next Next::at(unsigned long time)
+  {
+    return Next(kindAt, time);
+  }
+
+  Next Next::now()
+  {
+    return Next(kindAfter, 0);
+  }
+
+  Next Next::suspend()
+  {
+    return Next(kindSuspend, 0);
+  }
+
   CoRoutine::CoRoutine(bool waitRelativeToWorkerExit)
     : suspended(false),
-      waitRelativeToWorkerExit(waitRelativeToWorkerExit),
-      nextRun(0) // This is the first run.
+      asap(true), // This is the first run.
+      catchUpPolicy(waitRelativeToWorkerExit ? catchUpRelativeToExit : catchUpBurst),
+#ifndef CoRoutinesNoWatchdog
+      overrunLimit(0),
+      overrunsInARow(0),
+#endif
+      nextRun(0),
+      period(0),
+      slack(0),
+      missedPeriods(0),
+#ifndef CoRoutinesNoWatchdog
+      maxRunTime(0),
+      longestRunTime(0),
+      overrunCount(0),
+#endif
+#ifdef CoRoutinesHost
+      simulatedRunTime(0),
+      workerTime(0),
+#endif
+      owner(0),
+      ownerSlot(0)
+  { }
+
+  CoRoutine::CoRoutine(CatchUpPolicy catchUpPolicy)
+    : suspended(false),
+      asap(true), // This is the first run.
+      catchUpPolicy(catchUpPolicy),
+#ifndef CoRoutinesNoWatchdog
+      overrunLimit(0),
+      overrunsInARow(0),
+#endif
+      nextRun(0),
+      period(0),
+      slack(0),
+      missedPeriods(0),
+#ifndef CoRoutinesNoWatchdog
+      maxRunTime(0),
+      longestRunTime(0),
+      overrunCount(0),
+#endif
+#ifdef CoRoutinesHost
+      simulatedRunTime(0),
+      workerTime(0),
+#endif
+      owner(0),
+      ownerSlot(0)
   { }
   
-  void CoRoutine::resume()
+  CoRoutine::~CoRoutine()
+  {
+    if (owner != 0)
+    {
+      owner->removeCoRoutine(*this);
+    }
+  }
+
+  bool CoRoutine::isDue(unsigned long now)
+  {
+#ifdef CoRoutinesShortDeadlines
+    return asap || (TimeDifference) ((TimeStamp) now - nextRun) >= 0;
+#else
+    return asap || now >= nextRun;
+#endif
+  }
+
+  unsigned long CoRoutine::getNextRun(unsigned long now)
+  {
+    if (asap)
+    {
+      return now;
+    }
+#ifdef CoRoutinesShortDeadlines
+    // The next run time is within 32 seconds of 'now'.
+    return now + (TimeDifference) (nextRun - (TimeStamp) now);
+#else
+    return nextRun;
+#endif
+  }
+
+  void CoRoutine::setNextRun(unsigned long time)
+  {
+    nextRun = (TimeStamp) time;
+    asap = false;
+  }
+  
+  bool CoRoutine::resume()
   {
     // Is it time to run?
-    const unsigned long startOfRun = millis();
-    if (!suspended && startOfRun >= nextRun)
+    const unsigned long startOfRun = currentTime();
+    if (!suspended && isDue(startOfRun))
     {
       // Run now.
-      const int waitTime = worker();
+      const Next next = work();
+#ifdef CoRoutinesHost
+      if (clock != 0)
+      {
+        clock->workerRan(*this, startOfRun - getNextRun(startOfRun));
+      }
+#endif
+      const unsigned long endOfRun = currentTime();
+
+#ifndef CoRoutinesNoWatchdog
+      // Check the run time against the budget.
+      const unsigned long runTime = endOfRun - startOfRun;
+      if (runTime > longestRunTime)
+      {
+        longestRunTime = (runTime > 0xFFFF ? 0xFFFF : runTime);
+      }
+      if (maxRunTime != 0 && runTime > maxRunTime)
+      {
+        ++overrunCount;
+        ++overrunsInARow;
+        overrun(runTime);
+        
+        if (overrunLimit != 0 && overrunsInARow >= overrunLimit)
+        {
+          // Repeat offender. Suspend regardless of what the worker wants.
+          suspended = true;
+          changed();
+          return true;
+        }
+      }
+      else
+      {
+        overrunsInARow = 0;
+      }
+#endif
       
-      if (waitTime == -1)
+      if (next.kind == Next::kindSuspend)
       {
         // Worker signalled we are suspended.
         suspended = true;
       }
+      else if (next.kind == Next::kindAt)
+      {
+        // Worker asked for a specific time.
+        setNextRun(next.time);
+      }
       else
       {
+        const unsigned long waitTime = next.time;
+        if (period == 0 && waitTime != 0 && owner != 0)
+        {
+          // The first period of this co-routine may need staggering.
+          owner->staggerPending = true;
+        }
+        period = waitTime;
+
         // Schedule next run.
-        if (waitRelativeToWorkerExit)
+        if (catchUpPolicy == catchUpRelativeToExit)
         {
           // Set next run relative to now (when worker is completed).
-          nextRun = millis() + waitTime;
+          setNextRun(endOfRun + waitTime);
         }
         else
         {
-          if (nextRun != 0)
+          if (!asap)
           {
             // Set next run relative to this run.
-            nextRun += waitTime;
+            unsigned long runAt = getNextRun(startOfRun) + waitTime;
+            
+            if (waitTime > 0 && runAt < endOfRun)
+            {
+              // We are behind: the next period has already begun.
+              if (catchUpPolicy == catchUpSkip)
+              {
+                // Skip the periods that have passed keeping the phase.
+                const unsigned long missed = (endOfRun - runAt + waitTime - 1) / waitTime;
+                runAt += missed * waitTime;
+                missedPeriods += missed;
+              }
+              else
+              {
+                // The next period will be run late.
+                ++missedPeriods;
+              }
+            }
+            setNextRun(runAt);
           }
           else
           {
             // This is the first run.
-            nextRun = startOfRun + waitTime;
+            setNextRun(startOfRun + waitTime);
           }
         }
       }
+      changed();
+      return true;
     }
+    return false;
+  }
+  
+  Next CoRoutine::work()
+  {
+    const int waitTime = worker();
+    return (waitTime == -1 ? Next::suspend() : Next::after(waitTime));
   }
   
+  void CoRoutine::wakeAt(unsigned long time)
+  {
+    suspended = false;
+    setNextRun(time);
+    changed();
+  }
+
+#ifndef CoRoutinesNoWatchdog
+  void CoRoutine::overrun(unsigned long)
+  { }
+#endif
+
   bool CoRoutine::isSuspended()
   {
     return suspended;
@@ -94,129 +329,1304 @@ namespace coroutines {
   {
     if (suspended)
     {
-      nextRun = 0;
+      asap = true;
       suspended = false;
+#ifndef CoRoutinesNoWatchdog
+      overrunsInARow = 0;
+#endif
+      changed();
     }
   }
 
   void CoRoutine::suspend()
   {
     suspended = true;
+    changed();
+  }
+
+  void CoRoutine::wakeNow()
+  {
+    if (!suspended)
+    {
+      asap = true;
+      changed();
+    }
+  }
+
+  void CoRoutine::resumeNow()
+  {
+    if (suspended)
+    {
+      awake();
+    }
+    else
+    {
+      wakeNow();
+    }
+  }
+
+  void CoRoutine::changed()
+  {
+    if (owner != 0)
+    {
+      owner->coRoutineChanged(*this);
+    }
+  }
+
+#ifdef CoRoutinesHost
+  void CoRoutine::setSimulatedRunTime(unsigned long runTime)
+  {
+    simulatedRunTime = runTime;
+  }
+
+  unsigned long CoRoutine::getSimulatedRunTime()
+  {
+    return simulatedRunTime;
+  }
+
+  unsigned long CoRoutine::getWorkerTime()
+  {
+    return __atomic_load_n(&workerTime, __ATOMIC_RELAXED);
+  }
+
+  // Returns microseconds of the system's monotonic clock. Used for timing
+  // workers regardless of the clock set by 'setClock()'.
+  static unsigned long long systemMicros()
+  {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+  }
+#endif
+
+  unsigned long CoRoutine::getPeriod()
+  {
+    return period;
+  }
+
+  void CoRoutine::setPeriod(unsigned long period)
+  {
+    this->period = period;
+    if (owner != 0)
+    {
+      owner->staggerPending = true;
+    }
+  }
+
+  void CoRoutine::setSlack(unsigned int slack)
+  {
+    this->slack = slack;
+    changed();
+  }
+
+  unsigned int CoRoutine::getSlack()
+  {
+    return slack;
+  }
+
+  CoRoutine::CatchUpPolicy CoRoutine::getCatchUpPolicy()
+  {
+    return (CatchUpPolicy) catchUpPolicy;
+  }
+
+  unsigned int CoRoutine::getMissedPeriods()
+  {
+    return missedPeriods;
+  }
+
+#ifndef CoRoutinesNoWatchdog
+  void CoRoutine::setMaxRunTime(unsigned int maxRunTime, unsigned char suspendAfter)
+  {
+    this->maxRunTime = maxRunTime;
+    overrunLimit = suspendAfter;
+    overrunsInARow = 0;
+  }
+
+  unsigned int CoRoutine::getMaxRunTime()
+  {
+    return maxRunTime;
+  }
+
+  unsigned int CoRoutine::getLongestRunTime()
+  {
+    return longestRunTime;
+  }
+
+  unsigned int CoRoutine::getOverrunCount()
+  {
+    return overrunCount;
+  }
+
+  void CoRoutine::resetOverruns()
+  {
+    longestRunTime = 0;
+    overrunCount = 0;
+    overrunsInARow = 0;
+  }
+#endif
+
+  LongWaitCoRoutine::LongWaitCoRoutine(CatchUpPolicy catchUpPolicy)
+    : CoRoutine(catchUpPolicy)
+  { }
+
+  int LongWaitCoRoutine::worker()
+  {
+    return -1;
+  }
+
+  bool CoRoutineHandle::isValid() const
+  {
+    return index != (size_t) -1;
   }
 
   Scheduler::Scheduler()
-    : coRoutines(0),
+    : entries(0),
+      slots(0),
+      groups(0),
+      states(0),
+      pending(0),
+      noPending(0),
+      ready(0),
+      readyCount(0),
+      tickTime(0),
+      nextWakeup(0),
+      waiting(false),
+      wakeupKnown(true),
       arraySize(0),
-      noEntries(0)
+      growable(true),
+      noEntries(0),
+      freeSlots(0),
+      running(false),
+      removedWhileRunning(false),
+      suspendedGroups(0),
+      autoStagger(false),
+      staggerPending(false),
+      staggerRequested(false),
+#ifdef CoRoutinesHost
+      timeWorkers(false),
+#endif
+      wakeups(0),
+      busyTicks(0),
+      totalWork(0),
+      peakWork(0),
+      group(0),
+      timers(0),
+      noTimers(0),
+      freeTimers(0)
   { }
 
+  Scheduler::Scheduler(Entry* entries, Slot* slots, Pending* pending, unsigned char* groups,
+                       unsigned char* states, ReadyWord* ready, size_t capacity)
+    : entries(entries),
+      slots(slots),
+      groups(groups),
+      states(states),
+      pending(pending),
+      noPending(0),
+      ready(ready),
+      readyCount(0),
+      tickTime(0),
+      nextWakeup(0),
+      waiting(false),
+      wakeupKnown(true),
+      arraySize(capacity),
+      growable(false),
+      noEntries(0),
+      freeSlots(0),
+      running(false),
+      removedWhileRunning(false),
+      suspendedGroups(0),
+      autoStagger(false),
+      staggerPending(false),
+      staggerRequested(false),
+#ifdef CoRoutinesHost
+      timeWorkers(false),
+#endif
+      wakeups(0),
+      busyTicks(0),
+      totalWork(0),
+      peakWork(0),
+      group(0),
+      timers(0),
+      noTimers(0),
+      freeTimers(0)
+  {
+    // All slots are free.
+    for (size_t i = 0; i != capacity; ++i)
+    {
+      slots[i].entry = i + 1;
+      slots[i].pending = notPending;
+      slots[i].generation = 0;
+    }
+    memset(ready, 0, (capacity + readyBits - 1) / readyBits * sizeof(ReadyWord));
+  }
+
+
   Scheduler::~Scheduler()
   {
-    // De-allocate the array of co-routines.
+    // The co-routines no longer have a scheduler to tell about changes.
+    for (size_t i = 0; i != noEntries; ++i)
+    {
+      if (entries[i].coRoutine != 0)
+      {
+        entries[i].coRoutine->owner = 0;
+      }
+    }
+
+    // De-allocate the arrays of co-routines and slots, which are a single
+    // block starting with 'ready'.
     // (The pointers in the array are not owned by this class.)
-    free(coRoutines);
+    if (growable)
+    {
+      free(ready);
+    }
   }
 
-  void Scheduler::resize(size_t newSize)
+  bool Scheduler::resize(size_t newSize)
   {
     // Is array large enough?
     // If not enlarge it. (We never shrink it.)
     if (newSize > arraySize)
     {
+      if (!growable)
+      {
+        return false;
+      }
+      
       // Double the array (starting out with one place.)
       const size_t newSize = (arraySize == 0 ? 1 : 2 * arraySize);
       
-      // Allocate new array of pointers.
-      CoRoutine** const newArray = (CoRoutine**) malloc(newSize * sizeof(CoRoutine*));
+      // Allocate the new arrays as a single block. The words of the bitmap
+      // go first as they have the strictest alignment and the bytes last.
+      const size_t readyWords = (arraySize + readyBits - 1) / readyBits;
+      const size_t newReadyWords = (newSize + readyBits - 1) / readyBits;
+      char* const block = (char*) malloc(newReadyWords * sizeof(ReadyWord) +
+                                         newSize * (sizeof(Entry) + sizeof(Slot) + sizeof(Pending) + 2));
+      if (block == 0)
+      {
+        // Out of memory. Keep the old arrays.
+        return false;
+      }
+      ReadyWord* const newReady = (ReadyWord*) block;
+      Entry* const newEntries = (Entry*) (newReady + newReadyWords);
+      Slot* const newSlots = (Slot*) (newEntries + newSize);
+      Pending* const newPending = (Pending*) (newSlots + newSize);
+      unsigned char* const newGroups = (unsigned char*) (newPending + newSize);
+      unsigned char* const newStates = newGroups + newSize;
       
       // Copy over contents.
-      memcpy(newArray, coRoutines, arraySize * sizeof(CoRoutine*));
+      if (arraySize != 0)
+      {
+        memcpy(newReady, ready, readyWords * sizeof(ReadyWord));
+        memcpy(newEntries, entries, arraySize * sizeof(Entry));
+        memcpy(newSlots, slots, arraySize * sizeof(Slot));
+        memcpy(newPending, pending, noPending * sizeof(Pending));
+        memcpy(newGroups, groups, arraySize);
+        memcpy(newStates, states, arraySize);
+      }
+      memset(newReady + readyWords, 0, (newReadyWords - readyWords) * sizeof(ReadyWord));
+
+      // Chain the new slots onto the free list.
+      for (size_t i = arraySize; i != newSize; ++i)
+      {
+        newSlots[i].entry = i + 1;
+        newSlots[i].pending = notPending;
+        newSlots[i].generation = 0;
+      }
+      newSlots[newSize-1].entry = freeSlots;
 
-      // De-allocate the old array.
-      free(coRoutines);
+      // De-allocate the old arrays.
+      free(ready);
       
-      // Use new array from now.
-      coRoutines = newArray;
+      // Use new arrays from now.
+      entries = newEntries;
+      slots = newSlots;
+      pending = newPending;
+      groups = newGroups;
+      states = newStates;
+      ready = newReady;
+      freeSlots = arraySize;
       arraySize = newSize;
     }
+    return true;
   }
 
-  void Scheduler::addCoRoutine(CoRoutine& coRoutine)
-  {
-    #ifdef CoRoutinesDebug
-      Serial.print("Adding co-routine to scheduler: ");
-      Serial.println((unsigned long) &coRoutine);
-    #endif
-
-    // Increment entry counter and make sure there is room in the array.
-    ++noEntries;
-    resize(noEntries);
-    
-    // Insert the new coRoutine in the back.
-    coRoutines[noEntries-1] = &coRoutine;
-  }
-  
-  void Scheduler::removeCoRoutine(CoRoutine& coRoutine)
+  void Scheduler::mirror(size_t index)
   {
-    if (noEntries == 0)
+    CoRoutine& coRoutine = *entries[index].coRoutine;
+    const size_t slot = entries[index].slot;
+    states[index] = (coRoutine.suspended ? stateSuspended : 0);
+    if (coRoutine.suspended)
     {
-      // Nothing to remove.
+      clearReady(index);
+      unschedule(slot);
       return;
     }
     
-    // Find the index of the co-routine we would like to remove.
-    size_t foundIndex = noEntries;
-    for (size_t i = noEntries-1; i != 0; --i)
+    const uint32_t deadline = (uint32_t) coRoutine.getNextRun(tickTime);
+    const uint32_t latestRun = deadline + coRoutine.slack;
+    if ((int32_t) (deadline - tickTime) <= 0)
     {
-      if (coRoutines[i] == &coRoutine)
+      // Already due at the last run.
+      unschedule(slot);
+      setReady(index);
+      if (group != 0)
       {
-        foundIndex = i;
-        break;
+        wakeGroup(true, latestRun);
       }
     }
-    
-    // If found remove it, otherwise do nothing.
-    if (foundIndex != noEntries)
+    else
     {
-      // Number of entries after this one.
-      const size_t entriesToMove = noEntries - (foundIndex + 1);
-      
-      // Remove this entry by moving the entries after one to the left.
-      memcpy(&coRoutines[foundIndex], &coRoutines[foundIndex+1], entriesToMove);
-      --noEntries;
+      clearReady(index);
+      schedule(slot, deadline, coRoutine.slack);
+      if (wakeupKnown && (groups[index] & suspendedGroups) == 0 &&
+          (!waiting || (int32_t) (latestRun - nextWakeup) < 0))
+      {
+        nextWakeup = latestRun;
+        waiting = true;
+      }
+      if (group != 0 && (groups[index] & suspendedGroups) == 0)
+      {
+        wakeGroup(false, latestRun);
+      }
     }
   }
-   
-  void Scheduler::runOnce(bool removeCompletedCoRoutines)
+
+  void Scheduler::wakeGroup(bool ready, uint32_t latestRun)
   {
-    // Run each co-routine.
-    for (size_t i = 0; i != noEntries; ++i)
+    // While running, the worker of the group returns the next wakeup.
+    CoRoutine& coRoutine = *group;
+    if (running || coRoutine.suspended || coRoutine.asap)
     {
-      CoRoutine* const coRoutine = coRoutines[i];
-      coRoutine->resume();
+      return;
     }
-    
-    if (noEntries != 0 && removeCompletedCoRoutines)
+    if (ready)
     {
-      // Remove suspended co-routines.
-      // This could be implemented more effeciently, but I guess it is not
-      // really a problem unless you have many co-routines.
-      // We iterate from the back of the array to make sure deletions
-      // during the iteration do not make us skip an entry.
-      for (size_t i = noEntries-1; i != 0; --i)
-      {
-        if (coRoutines[i]->isSuspended())
-        {
-          removeCoRoutine(*coRoutines[i]);
-        }
-      }
+      coRoutine.wakeNow();
+    }
+    else if ((int32_t) (latestRun - (uint32_t) coRoutine.getNextRun(latestRun)) < 0)
+    {
+      coRoutine.setNextRun(latestRun);
+      coRoutine.changed();
+    }
+  }
+
+  void Scheduler::coRoutineChanged(CoRoutine& coRoutine)
+  {
+    mirror(slots[coRoutine.ownerSlot].entry);
+  }
+
+  void Scheduler::moveEntry(size_t from, size_t to)
+  {
+    entries[to] = entries[from];
+    groups[to] = groups[from];
+    states[to] = states[from];
+    slots[entries[to].slot].entry = to;
+    if (isReady(from))
+    {
+      clearReady(from);
+      setReady(to);
+    }
+  }
+
+  bool Scheduler::isActive(size_t index)
+  {
+    return states[index] == 0 && (groups[index] & suspendedGroups) == 0;
+  }
+
+  // Returns the index of the lowest bit set in 'bits' (which is not 0.)
+#ifdef CoRoutinesHost
+  static inline unsigned char lowestBit(uint64_t bits)
+  {
+  #if defined(__GNUC__)
+    return (unsigned char) __builtin_ctzll(bits);
+  #else
+    unsigned char bit = 0;
+    for (; (bits & 1) == 0; bits >>= 1)
+    {
+      ++bit;
+    }
+    return bit;
+  #endif
+  }
+#else
+  static inline unsigned char lowestBit(uint8_t bits)
+  {
+  #if defined(__GNUC__)
+    return (unsigned char) __builtin_ctz(bits);
+  #else
+    unsigned char bit = 0;
+    for (; (bits & 1) == 0; bits >>= 1)
+    {
+      ++bit;
     }
+    return bit;
+  #endif
+  }
+#endif
+
+  void Scheduler::setReady(size_t index)
+  {
+    const ReadyWord bit = (ReadyWord) 1 << (index % readyBits);
+    if ((ready[index / readyBits] & bit) == 0)
+    {
+      ready[index / readyBits] |= bit;
+      ++readyCount;
+    }
+  }
+
+  void Scheduler::clearReady(size_t index)
+  {
+    const ReadyWord bit = (ReadyWord) 1 << (index % readyBits);
+    if ((ready[index / readyBits] & bit) != 0)
+    {
+      ready[index / readyBits] &= ~bit;
+      --readyCount;
+    }
+  }
+
+  bool Scheduler::isReady(size_t index)
+  {
+    return (ready[index / readyBits] & ((ReadyWord) 1 << (index % readyBits))) != 0;
+  }
+
+  void Scheduler::schedule(size_t slot, uint32_t deadline, unsigned int slack)
+  {
+    Pending node;
+    node.deadline = deadline;
+    node.slack = slack;
+    node.slot = slot;
+    
+    size_t index = slots[slot].pending;
+    if (index == notPending)
+    {
+      placePendingUp(noPending++, node);
+      return;
+    }
+    
+    // The next wakeup may have been this entry's.
+    if (pending[index].deadline + pending[index].slack == nextWakeup)
+    {
+      wakeupKnown = false;
+    }
+    if ((int32_t) (deadline - pending[index].deadline) < 0)
+    {
+      placePendingUp(index, node);
+    }
+    else
+    {
+      placePendingDown(index, node);
+    }
+  }
+
+  void Scheduler::unschedule(size_t slot)
+  {
+    const size_t index = slots[slot].pending;
+    if (index == notPending)
+    {
+      return;
+    }
+    if (pending[index].deadline + pending[index].slack == nextWakeup)
+    {
+      wakeupKnown = false;
+    }
+    slots[slot].pending = notPending;
+    
+    // Fill the hole with the last node.
+    const Pending last = pending[--noPending];
+    if (index == noPending)
+    {
+      return;
+    }
+    if ((int32_t) (last.deadline - pending[index].deadline) < 0)
+    {
+      placePendingUp(index, last);
+    }
+    else
+    {
+      placePendingDown(index, last);
+    }
+  }
+
+  void Scheduler::placePendingUp(size_t index, Pending node)
+  {
+    while (index != 0)
+    {
+      const size_t parent = (index - 1) / 2;
+      if ((int32_t) (node.deadline - pending[parent].deadline) >= 0)
+      {
+        break;
+      }
+      pending[index] = pending[parent];
+      slots[pending[index].slot].pending = index;
+      index = parent;
+    }
+    pending[index] = node;
+    slots[node.slot].pending = index;
+  }
+
+  void Scheduler::placePendingDown(size_t index, Pending node)
+  {
+    for (;;)
+    {
+      size_t child = 2 * index + 1;
+      if (child >= noPending)
+      {
+        break;
+      }
+      if (child + 1 < noPending &&
+          (int32_t) (pending[child + 1].deadline - pending[child].deadline) < 0)
+      {
+        ++child;
+      }
+      if ((int32_t) (pending[child].deadline - node.deadline) >= 0)
+      {
+        break;
+      }
+      pending[index] = pending[child];
+      slots[pending[index].slot].pending = index;
+      index = child;
+    }
+    pending[index] = node;
+    slots[node.slot].pending = index;
+  }
+
+  void Scheduler::markDue()
+  {
+    // Entries of suspended groups are marked too. They stay ready until
+    // their groups are awakened.
+    while (noPending != 0 && (int32_t) (pending[0].deadline - tickTime) <= 0)
+    {
+      const size_t slot = pending[0].slot;
+      unschedule(slot);
+      setReady(slots[slot].entry);
+    }
+  }
+
+  void Scheduler::findWakeup()
+  {
+    // The next wakeup is the earliest latest run time of the active
+    // pending entries. No entry below a node of the heap has a latest run
+    // time earlier than the deadline of the node, so the subtree of a
+    // node whose deadline is not earlier than the best time found so far
+    // is skipped. The heap is walked in pre-order without a stack.
+    waiting = false;
+    wakeupKnown = true;
+    size_t index = 0;
+    while (noPending != 0)
+    {
+      const Pending& node = pending[index];
+      const uint32_t latestRun = node.deadline + node.slack;
+      bool descend = false;
+      if (!waiting || (int32_t) (node.deadline - nextWakeup) < 0)
+      {
+        if ((!waiting || (int32_t) (latestRun - nextWakeup) < 0) &&
+            (groups[slots[node.slot].entry] & suspendedGroups) == 0)
+        {
+          nextWakeup = latestRun;
+          waiting = true;
+        }
+        descend = (2 * index + 1 < noPending);
+      }
+      
+      if (descend)
+      {
+        index = 2 * index + 1;
+        continue;
+      }
+      
+      // Go on with the right sibling of the nearest left child on the
+      // way back up.
+      while (index != 0 && (index % 2 == 0 || index + 1 == noPending))
+      {
+        index = (index - 1) / 2;
+      }
+      if (index == 0)
+      {
+        return;
+      }
+      ++index;
+    }
+  }
+
+  Scheduler::Entry* Scheduler::findEntry(CoRoutineHandle handle)
+  {
+    if (handle.index >= arraySize || slots[handle.index].generation != handle.generation)
+    {
+      return 0;
+    }
+    
+    // The generation of a free slot never matches a handle given out.
+    return &entries[slots[handle.index].entry];
+  }
+
+  CoRoutineHandle Scheduler::addCoRoutine(CoRoutine& coRoutine, unsigned char groups)
+  {
+    #ifdef CoRoutinesDebug
+      Serial.print("Adding co-routine to scheduler: ");
+      Serial.println((unsigned long) &coRoutine);
+    #endif
+
+    // Make sure there is room in the array and increment entry counter.
+    // A co-routine already member of a scheduler is not added again.
+    CoRoutineHandle handle;
+    if (coRoutine.owner != 0 || !resize(noEntries + 1))
+    {
+      handle.index = (size_t) -1;
+      handle.generation = 0;
+      return handle;
+    }
+    ++noEntries;
+
+    // Take the first free slot.
+    const size_t slot = freeSlots;
+    freeSlots = slots[slot].entry;
+    slots[slot].entry = noEntries-1;
+    
+    // Insert the new coRoutine in the back.
+    entries[noEntries-1].coRoutine = &coRoutine;
+    entries[noEntries-1].slot = slot;
+    this->groups[noEntries-1] = groups;
+    coRoutine.owner = this;
+    coRoutine.ownerSlot = slot;
+    mirror(noEntries-1);
+    if (coRoutine.period != 0)
+    {
+      staggerPending = true;
+    }
+
+    handle.index = slot;
+    handle.generation = slots[slot].generation;
+    return handle;
+  }
+
+  void Scheduler::removeEntry(size_t index)
+  {
+    // Free the slot. Bumping the generation makes handles to it stale.
+    const size_t slot = entries[index].slot;
+    unschedule(slot);
+    ++slots[slot].generation;
+    slots[slot].entry = freeSlots;
+    freeSlots = slot;
+    if (entries[index].coRoutine->period != 0)
+    {
+      staggerPending = true;
+    }
+    entries[index].coRoutine->owner = 0;
+    clearReady(index);
+
+    if (running)
+    {
+      // Do not move entries under the feet of 'runOnce()'.
+      entries[index].coRoutine = 0;
+      states[index] = stateRemoved;
+      removedWhileRunning = true;
+    }
+    else
+    {
+      // Move the last entry into the hole.
+      --noEntries;
+      if (index != noEntries)
+      {
+        moveEntry(noEntries, index);
+      }
+    }
+  }
+
+  void Scheduler::compact()
+  {
+    for (size_t i = noEntries; i != 0; --i)
+    {
+      if (entries[i-1].coRoutine == 0)
+      {
+        --noEntries;
+        if (i-1 != noEntries)
+        {
+          moveEntry(noEntries, i-1);
+        }
+      }
+    }
+    removedWhileRunning = false;
+  }
+  
+  void Scheduler::removeCoRoutine(CoRoutine& coRoutine)
+  {
+    if (coRoutine.owner == this)
+    {
+      removeEntry(slots[coRoutine.ownerSlot].entry);
+    }
+  }
+
+  bool Scheduler::removeCoRoutine(CoRoutineHandle handle)
+  {
+    Entry* const entry = findEntry(handle);
+    if (entry == 0)
+    {
+      return false;
+    }
+    removeEntry(entry - entries);
+    return true;
+  }
+
+  CoRoutine* Scheduler::getCoRoutine(CoRoutineHandle handle)
+  {
+    Entry* const entry = findEntry(handle);
+    return (entry == 0 ? 0 : entry->coRoutine);
+  }
+
+  bool Scheduler::awakeCoRoutine(CoRoutineHandle handle)
+  {
+    Entry* const entry = findEntry(handle);
+    if (entry == 0)
+    {
+      return false;
+    }
+    entry->coRoutine->awake();
+    return true;
+  }
+
+  void Scheduler::setGroups(CoRoutine& coRoutine, unsigned char groups)
+  {
+    if (coRoutine.owner == this)
+    {
+      this->groups[slots[coRoutine.ownerSlot].entry] = groups;
+      
+      // The co-routine may have joined or left a suspended group.
+      wakeupKnown = false;
+    }
+  }
+
+  void Scheduler::suspendGroup(unsigned char groups)
+  {
+    suspendedGroups |= groups;
+    wakeupKnown = false;
+  }
+
+  void Scheduler::awakeGroup(unsigned char groups)
+  {
+    suspendedGroups &= ~groups;
+    
+    // Entries of the groups which became due while suspended are ready.
+    wakeupKnown = false;
+    if (group != 0)
+    {
+      wakeGroup(true, tickTime);
+    }
+  }
+
+  unsigned char Scheduler::getSuspendedGroups()
+  {
+    return suspendedGroups;
+  }
+
+  void Scheduler::runOnce(bool removeCompletedCoRoutines)
+  {
+    if (staggerRequested || (autoStagger && staggerPending))
+    {
+      staggerPhases();
+    }
+
+    // Mark the entries whose deadlines have been reached as ready.
+    ++wakeups;
+    tickTime = (uint32_t) currentTime();
+    markDue();
+
+    // Run each ready co-routine.
+    // Co-routines removed by a worker are only marked as removed until all
+    // co-routines have been run.
+    const bool wasRunning = running;
+    running = true;
+    size_t work = 0;
+    for (size_t word = 0; readyCount != 0 && word * readyBits < noEntries; ++word)
+    {
+      ReadyWord bits = ready[word];
+      while (bits != 0)
+      {
+        const size_t i = word * readyBits + lowestBit(bits);
+        bits &= bits - 1;
+        
+        // A worker run earlier may have removed the entry or suspended its groups.
+        CoRoutine* const coRoutine = entries[i].coRoutine;
+        if (coRoutine == 0 || (groups[i] & suspendedGroups) != 0)
+        {
+          continue;
+        }
+#ifdef CoRoutinesHost
+        if (timeWorkers)
+        {
+          const unsigned long long start = systemMicros();
+          if (coRoutine->resume())
+          {
+            ++work;
+            
+            // The worker may have removed (and destroyed) its co-routine.
+            if (entries[i].coRoutine == coRoutine)
+            {
+              __atomic_store_n(&coRoutine->workerTime,
+                               coRoutine->workerTime + (unsigned long) (systemMicros() - start),
+                               __ATOMIC_RELAXED);
+            }
+          }
+          continue;
+        }
+#endif
+        if (coRoutine->resume())
+        {
+          ++work;
+        }
+      }
+    }
+    running = wasRunning;
+    if (!running && removedWhileRunning)
+    {
+      compact();
+    }
+    
+    if (work != 0)
+    {
+      ++busyTicks;
+      totalWork += work;
+      if (work > peakWork)
+      {
+        peakWork = work;
+      }
+    }
+    
+    if (noEntries != 0 && removeCompletedCoRoutines)
+    {
+      // Remove suspended co-routines.
+      // We iterate from the back of the array to make sure the entries
+      // moved into the holes have already been checked.
+      for (size_t i = noEntries; i != 0; --i)
+      {
+        if ((states[i-1] & stateSuspended) != 0 && !isTimer(*entries[i-1].coRoutine))
+        {
+          removeEntry(i-1);
+        }
+      }
+    }
+  }
+
+#ifndef CoRoutinesNoWatchdog
+  unsigned long Scheduler::getOverrunCount()
+  {
+    unsigned long count = 0;
+    for (size_t i = 0; i != noEntries; ++i)
+    {
+      if (entries[i].coRoutine != 0)
+      {
+        count += entries[i].coRoutine->getOverrunCount();
+      }
+    }
+    return count;
+  }
+#endif
+
+  unsigned long Scheduler::staggerPeriod(size_t index)
+  {
+    return (isActive(index) ? entries[index].coRoutine->period : 0);
+  }
+
+  void Scheduler::swapEntries(size_t a, size_t b)
+  {
+    const Entry entry = entries[a];
+    const unsigned char group = groups[a];
+    const unsigned char state = states[a];
+    const bool wasReady = isReady(a);
+    
+    entries[a] = entries[b];
+    groups[a] = groups[b];
+    states[a] = states[b];
+    slots[entries[a].slot].entry = a;
+    if (isReady(b))
+    {
+      setReady(a);
+    }
+    else
+    {
+      clearReady(a);
+    }
+
+    entries[b] = entry;
+    groups[b] = group;
+    states[b] = state;
+    slots[entry.slot].entry = b;
+    if (wasReady)
+    {
+      setReady(b);
+    }
+    else
+    {
+      clearReady(b);
+    }
+  }
+
+  void Scheduler::siftDown(size_t root, size_t end)
+  {
+    for (;;)
+    {
+      size_t child = 2 * root + 1;
+      if (child >= end)
+      {
+        return;
+      }
+      if (child + 1 < end && staggerPeriod(child) < staggerPeriod(child + 1))
+      {
+        ++child;
+      }
+      if (staggerPeriod(root) >= staggerPeriod(child))
+      {
+        return;
+      }
+      swapEntries(root, child);
+      root = child;
+    }
+  }
+
+  void Scheduler::sortByPeriod()
+  {
+    // Usually the entries are still sorted since the last stagger.
+    size_t unsorted = 1;
+    while (unsorted < noEntries && staggerPeriod(unsorted - 1) <= staggerPeriod(unsorted))
+    {
+      ++unsorted;
+    }
+    if (unsorted >= noEntries)
+    {
+      return;
+    }
+
+    // Heap sort needs no memory besides the arrays.
+    for (size_t i = noEntries / 2; i != 0; --i)
+    {
+      siftDown(i - 1, noEntries);
+    }
+    for (size_t end = noEntries; end > 1; --end)
+    {
+      swapEntries(0, end - 1);
+      siftDown(0, end - 1);
+    }
+  }
+
+  void Scheduler::staggerPhases()
+  {
+    if (running)
+    {
+      // Entries must not move under the feet of 'runOnce()'.
+      staggerRequested = true;
+      return;
+    }
+    
+    // Co-routines sharing a period end up next to each other.
+    sortByPeriod();
+    
+    const unsigned long now = currentTime();
+    size_t first = 0;
+    while (first != noEntries)
+    {
+      const unsigned long period = staggerPeriod(first);
+      size_t end = first + 1;
+      while (end != noEntries && staggerPeriod(end) == period)
+      {
+        ++end;
+      }
+      if (period == 0)
+      {
+        // Not active or without a period.
+        first = end;
+        continue;
+      }
+      
+      // Find the earliest time any of the co-routines would run.
+      unsigned long anchor = 0;
+      for (size_t j = first; j != end; ++j)
+      {
+        const unsigned long nextRun = entries[j].coRoutine->getNextRun(now);
+        const unsigned long runAt = (nextRun < now ? now : nextRun);
+        if (j == first || runAt < anchor)
+        {
+          anchor = runAt;
+        }
+      }
+      
+      // Assign evenly spaced phases from the anchor.
+      const size_t count = end - first;
+      for (size_t j = first; j != end; ++j)
+      {
+        entries[j].coRoutine->setNextRun(anchor + (period * (j - first)) / count);
+        mirror(j);
+      }
+      first = end;
+    }
+    
+    staggerPending = false;
+    staggerRequested = false;
+  }
+
+  void Scheduler::setAutoStagger(bool autoStagger)
+  {
+    this->autoStagger = autoStagger;
+    staggerPending = true;
+  }
+
+#ifdef CoRoutinesHost
+  void Scheduler::setTimeWorkers(bool timeWorkers)
+  {
+    this->timeWorkers = timeWorkers;
+  }
+#endif
+
+  size_t Scheduler::getPeakTickWork()
+  {
+    return peakWork;
+  }
+
+  float Scheduler::getMeanTickWork()
+  {
+    return (busyTicks == 0 ? 0.0f : (float) totalWork / busyTicks);
+  }
+
+  void Scheduler::resetTickStats()
+  {
+    wakeups = 0;
+    busyTicks = 0;
+    totalWork = 0;
+    peakWork = 0;
+  }
+
+  bool Scheduler::hasActiveReady()
+  {
+    if (readyCount == 0 || suspendedGroups == 0)
+    {
+      return readyCount != 0;
+    }
+    
+    // Entries of suspended groups stay ready until their groups are awakened.
+    for (size_t word = 0; word * readyBits < noEntries; ++word)
+    {
+      for (ReadyWord bits = ready[word]; bits != 0; bits &= bits - 1)
+      {
+        if ((groups[word * readyBits + lowestBit(bits)] & suspendedGroups) == 0)
+        {
+          return true;
+        }
+      }
+    }
+    return false;
+  }
+
+  unsigned long Scheduler::getNextWakeup()
+  {
+    // The latest time that still honours the slack of every co-routine.
+    // A co-routine ready to run needs a wakeup now.
+    const unsigned long now = currentTime();
+    if (hasActiveReady())
+    {
+      return now;
+    }
+    if (!wakeupKnown)
+    {
+      findWakeup();
+    }
+    if (!waiting)
+    {
+      return (unsigned long) -1;
+    }
+    const int32_t wait = (int32_t) (nextWakeup - (uint32_t) now);
+    return (wait > 0 ? now + wait : now);
+  }
+
+  unsigned long Scheduler::getTimeToNextWakeup(unsigned long maxTime)
+  {
+    const unsigned long wakeup = getNextWakeup();
+    const unsigned long now = currentTime();
+    const unsigned long time = (wakeup > now ? wakeup - now : 0);
+    return (time < maxTime ? time : maxTime);
+  }
+
+  unsigned long Scheduler::getWakeupCount()
+  {
+    return wakeups;
+  }
+
+  float Scheduler::getCoalescingRatio()
+  {
+    return (wakeups == 0 ? 0.0f : (float) totalWork / wakeups);
+  }
+
+  unsigned char Scheduler::setTimers(Timer* timers, unsigned char noTimers, unsigned char groups)
+  {
+    this->timers = timers;
+    this->noTimers = noTimers;
+    
+    // Timers not in use are suspended co-routines on the free list.
+    // A timer that cannot be added is kept off the list.
+    freeTimers = 0;
+    Timer** last = &freeTimers;
+    unsigned char added = 0;
+    for (unsigned char i = 0; i != noTimers; ++i)
+    {
+      Timer& timer = timers[i];
+      timer.suspend();
+      if (!addCoRoutine(timer, groups).isValid())
+      {
+        continue;
+      }
+      timer.scheduler = this;
+      timer.nextFree = 0;
+      *last = &timer;
+      last = &timer.nextFree;
+      ++added;
+    }
+    return added;
+  }
+
+  TimerHandle Scheduler::startTimer(unsigned int delay, unsigned int interval,
+                                    TimerCallback callback, void* context)
+  {
+    TimerHandle handle;
+    Timer* const timer = freeTimers;
+    if (timer == 0)
+    {
+      // All timers are in use.
+      handle.index = 0xFF;
+      handle.generation = 0;
+      return handle;
+    }
+    freeTimers = timer->nextFree;
+    
+    timer->callback = callback;
+    timer->context = context;
+    timer->interval = interval;
+    timer->wakeAt(currentTime() + delay);
+    
+    handle.index = timer - timers;
+    handle.generation = timer->generation;
+    return handle;
+  }
+
+  bool Scheduler::isTimer(CoRoutine& coRoutine)
+  {
+    for (unsigned char i = 0; i != noTimers; ++i)
+    {
+      if (&coRoutine == &timers[i])
+      {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void Scheduler::releaseTimer(Timer& timer)
+  {
+    timer.suspend();
+    timer.callback = 0;
+    ++timer.generation;
+    timer.nextFree = freeTimers;
+    freeTimers = &timer;
+  }
+
+  TimerHandle Scheduler::callAfter(unsigned int delay, TimerCallback callback, void* context)
+  {
+    return startTimer(delay, 0, callback, context);
+  }
+
+  TimerHandle Scheduler::callEvery(unsigned int interval, TimerCallback callback, void* context)
+  {
+    return startTimer(interval, interval, callback, context);
+  }
+
+  bool Scheduler::cancelTimer(TimerHandle handle)
+  {
+    if (handle.index >= noTimers)
+    {
+      return false;
+    }
+    
+    Timer& timer = timers[handle.index];
+    if (timer.generation != handle.generation || timer.callback == 0)
+    {
+      // The timer has ended, maybe the entry is used by another timer now.
+      return false;
+    }
+    
+    if (timer.firing)
+    {
+      // Let the timer release itself when the callback returns.
+      timer.interval = 0;
+    }
+    else
+    {
+      releaseTimer(timer);
+    }
+    return true;
+  }
+
+  bool TimerHandle::isValid() const
+  {
+    return index != 0xFF;
+  }
+
+  Timer::Timer()
+    : scheduler(0),
+      callback(0),
+      context(0),
+      interval(0),
+      generation(0),
+      firing(false),
+      nextFree(0)
+  { }
+
+  int Timer::worker()
+  {
+    firing = true;
+    callback(context);
+    firing = false;
+    
+    if (interval == 0)
+    {
+      // Fired once or cancelled by the callback.
+      scheduler->releaseTimer(*this);
+      return -1;
+    }
+    return interval;
+  }
+
+  CoRoutineGroup::CoRoutineGroup(Scheduler& scheduler)
+    : CoRoutine(catchUpRelativeToExit),
+      scheduler(scheduler)
+  {
+    scheduler.group = this;
+  }
+
+  CoRoutineGroup::~CoRoutineGroup()
+  {
+    if (scheduler.group == this)
+    {
+      scheduler.group = 0;
+    }
+  }
+
+  int CoRoutineGroup::worker()
+  {
+    scheduler.runOnce();
+    
+    // Wait until the first co-routine of the group is due. The wait time
+    // of a worker is an int, so wait as long as possible and check again
+    // if it is longer than that.
+    const unsigned long maxWaitTime = ((unsigned int) -1) >> 1;
+    return (int) scheduler.getTimeToNextWakeup(maxWaitTime);
+  }
+
+  Scheduler& CoRoutineGroup::getScheduler()
+  {
+    return scheduler;
   }
 
 } // end of namespace coroutines
   
 
-#if !defined(ARDUINO) || ARDUINO < 100
+#if !defined(CoRoutinesHost) && (!defined(ARDUINO) || ARDUINO < 100)
 // We need this code to allow pure virtual functions
 // as the Arduino C++ compiler does not include it.
 // It should *never* be called.
@@ -42,6 +42,33 @@
 
   If you need state in your co-routine tasks, place that in your subclass.
 
+  The wait time returned by a worker is an 'int' which is 16 bits on AVR,
+  so a worker cannot wait longer than 32.767 seconds. Derive from class
+  LongWaitCoRoutine and override LongWaitCoRoutine::work() instead to
+  return a Next telling to wait any number of milliseconds, to wait until
+  a given time, to run again as soon as possible or to suspend:
+
+    Next work()
+    {
+      ...
+      return Next::after(3600000UL); // Run again in an hour.
+    }
+
+  A co-routine can declare the maximum time its worker is expected to run
+  by calling CoRoutine::setMaxRunTime(). Every invocation of the worker is
+  then timed and an invocation exceeding the budget is counted as an overrun
+  and reported to CoRoutine::overrun() which can be overridden. Optionally,
+  a co-routine overrunning its budget a number of times in a row is
+  suspended automatically.
+
+  When a periodic co-routine is invoked late, e.g. because another worker
+  ran for a long time, the catch-up policy given when constructing the
+  co-routine decides what happens to the periods that were missed:
+  they can be run back-to-back (burst, the default), skipped so the
+  co-routine realigns to its original phase, or ignored by always
+  waiting relative to when the worker exited. Each co-routine counts its
+  missed periods, see CoRoutine::getMissedPeriods().
+
   This co-routine implementation does not make use of ugly tricks
   (like macros with unmatched braces, switch statements and case labels inside
   other control structures) like you will see in other implementation as
@@ -73,22 +100,285 @@
   when calling Scheduler::runOnce(). The latter imposes a small overhead in the
   scheduler even if no tasks are suspended, as the scheduler needs to keep track
   of which tasks are suspended.
+
+  Scheduler::addCoRoutine() returns a handle identifying the co-routine
+  within the scheduler. The handle can be used for removing, awakening or
+  looking up the co-routine in constant time. A handle of a co-routine
+  that has been removed is detected as stale and ignored, unless its slot
+  has been reused 65536 times (2^32 times on a host) since. Note that
+  removing a co-routine may change the order in which the remaining
+  co-routines are resumed.
+
+  Co-routines sharing the same period and starting at the same time will
+  stay phase-locked and be invoked in the same run of the scheduler forever.
+  Call Scheduler::staggerPhases() to spread the run times of co-routines
+  sharing a period evenly across the period, or enable it automatically
+  with Scheduler::setAutoStagger(). The period of a co-routine is the last
+  wait time returned by its worker, so automatic staggering also happens
+  after the first run of a co-routine. To stagger co-routines before their
+  first run declare their period with CoRoutine::setPeriod().
+  The scheduler keeps track of how many workers are invoked per run,
+  see Scheduler::getPeakTickWork() and Scheduler::getMeanTickWork().
+
+  Instead of calling Scheduler::runOnce() continuously, you can sleep until
+  the next co-routine is due:
+
+    void loop()
+    {
+      scheduler.runOnce();
+      delay(scheduler.getTimeToNextWakeup(100));
+    }
+
+  The argument caps the sleep. Without it a scheduler whose co-routines
+  are all suspended sleeps practically forever, and 'serialEvent()', which
+  is only called between calls of 'loop()', never runs.
+
+  Co-routines that do not need to run exactly on time can declare a slack
+  with CoRoutine::setSlack(). The scheduler then picks the latest wakeup
+  time that still honours the slack of every co-routine so co-routines
+  falling within the same window are invoked in the same wakeup.
+  Scheduler::getCoalescingRatio() tells how many workers were invoked per
+  wakeup on average, counting wakeups that invoked no worker at all.
+
+  Co-routines can be tagged with group bits when added to a scheduler.
+  Scheduler::suspendGroup() and Scheduler::awakeGroup() suspend and awake
+  all co-routines of one or more groups at once by changing a single mask
+  in the scheduler. Co-routines of suspended groups are skipped without
+  being touched at all. This is useful for switching between operating
+  modes.
+
+  The scheduler keeps a copy of the state of each of its co-routines in
+  dense arrays, a bitmap of the co-routines ready to run and a binary heap
+  of the other co-routines ordered by next run time. Scheduler::runOnce()
+  moves the co-routines which have become due from the heap to the bitmap
+  and then only visits the co-routines marked in the bitmap.
+  Scheduler::getNextWakeup() finds the earliest next run time plus slack
+  in the heap, only visiting co-routines due before it.
+  Awakening a co-routine marks it right away. Co-routines tell their
+  scheduler when they are awakened or suspended, so a co-routine can be
+  added to one scheduler at a time only. Adding it to a second scheduler
+  returns a handle that is not valid.
+
+  To call a function once after a delay, or periodically, without writing
+  a co-routine for it, give the scheduler a pool of timers and use
+  Scheduler::callAfter() or Scheduler::callEvery():
+
+    Timer timers[4];
+    scheduler.setTimers(timers, 4);
+    ...
+    TimerHandle handle = scheduler.callAfter(500, switchOffLed);
+
+  The timers are co-routines of the scheduler, so starting, firing and
+  cancelling (Scheduler::cancelTimer()) a timer never allocates memory.
+  If all timers of the pool are in use, the returned handle is not valid.
+  Each timer takes the room of a co-routine in the scheduler. Timers that
+  do not fit are never used, see the return value of setTimers().
+
+  The arrays of a Scheduler are allocated from the heap and doubled in size
+  when full. To avoid the heap, e.g. on boards with little RAM, use a
+  FixedScheduler which holds room for a fixed number of co-routines:
+
+    FixedScheduler<8> scheduler;
+
+  Adding more co-routines than there is room for returns a handle that is
+  not valid. The same happens with a Scheduler if memory is exhausted.
+
+  CoRoutineGroup
+  --------------
+  A CoRoutineGroup is a co-routine running a scheduler of its own. This
+  allows a group of co-routines, e.g. those of a subsystem, to be added to
+  another scheduler as a single co-routine:
+
+    Scheduler sensors;
+    sensors.addCoRoutine(coRoutine1);
+    sensors.addCoRoutine(coRoutine2);
+    CoRoutineGroup sensorGroup(sensors);
+    scheduler.addCoRoutine(sensorGroup);
+
+  The group is due when the first of its co-routines is due so the outer
+  scheduler skips the whole group cheaply when nothing in it is due.
+  Suspending or awakening the group suspends or awakes the whole subsystem.
+  When one of its co-routines is awakened or made due earlier from
+  outside, e.g. by a Promise, an RxBuffer or an EventLoop, the scheduler
+  of the group makes the group due as well.
+
+  Memory use
+  ----------
+  Co-routines can be made smaller by uncommenting the defines
+  'CoRoutinesShortDeadlines' (16 bit next run times, wait times below 32
+  seconds) and 'CoRoutinesNoWatchdog' (no overrun watchdog) below. See
+  README.md for the size of a co-routine in each configuration.
+
+  A scheduler takes another 20 bytes per co-routine on AVR (58 bytes on a
+  64 bit host) for its arrays. A Scheduler doubles its arrays when full,
+  so it may hold room for up to twice as many co-routines as it has.
+
+  Host builds
+  -----------
+  The library can also be built for a host (e.g. Linux) rather than an
+  Arduino board. This is detected by 'ARDUINO' not being defined and sets
+  'CoRoutinesHost'. On a host, time is read from the system's monotonic
+  clock and the clock can be replaced by a virtual clock, see
+  "Simulation.h".
  */
 
 #ifndef __coroutines_h__
 #define __coroutines_h__
 
 #include <stdlib.h>
+#include <stdint.h>
+
+#if !defined(ARDUINO) && !defined(CoRoutinesHost)
+  #define CoRoutinesHost
+#endif
+
+/*
+ Uncomment this define to store the next run time and period of each
+ co-routine in 16 bits rather than 32 bits. Periods (i.e. wait times
+ returned by workers) and the time a co-routine is run late must then stay
+ below 32 seconds.
+ */
+// #define CoRoutinesShortDeadlines
+
+/*
+ Uncomment this define to leave out the overrun watchdog, i.e.
+ CoRoutine::setMaxRunTime() and friends, saving 8 bytes per co-routine on AVR.
+ */
+// #define CoRoutinesNoWatchdog
 
 namespace coroutines {
 
+  // Returns the current time in milliseconds as seen by co-routines.
+  // On Arduino this is 'millis()'.
+  unsigned long currentTime();
+
+#ifdef CoRoutinesHost
+  class CoRoutine;
+
+  // A source of time replacing the system clock on a host.
+  class Clock
+  {
+  public:
+    virtual ~Clock();
+
+    // Returns the current time in milliseconds.
+    virtual unsigned long now() = 0;
+
+    // Called when the worker of 'coRoutine' has returned.
+    // 'lateness' is how many milliseconds after its run time it was invoked.
+    virtual void workerRan(CoRoutine& coRoutine, unsigned long lateness);
+  };
+
+  // Use 'clock' as source of time for all co-routines.
+  // Pass 0 to go back to the system clock.
+  void setClock(Clock* clock);
+#endif
+
+  class Scheduler;
+
+  // What a co-routine wants to happen after its worker has run.
+  class Next
+  {
+  private:
+    enum Kind
+    {
+      kindAfter,
+      kindAt,
+      kindSuspend
+    };
+
+    Kind kind;
+    unsigned long time;
+
+    Next(Kind kind, unsigned long time);
+
+  public:
+    // Run again in 'waitTime' milliseconds.
+    static Next after(unsigned long waitTime);
+
+    // Run again at 'time' (as returned by 'currentTime()'.)
+    static Next at(unsigned long time);
+
+    // Run again as soon as possible.
+    static Next now();
+
+    // Suspend until awakened.
+    static Next suspend();
+
+    friend class CoRoutine;
+  };
+
   // A simple co-routine.
   class CoRoutine
   {
+  public:
+    // What to do when the worker is invoked so late that the next
+    // period has already begun when it exits.
+    enum CatchUpPolicy
+    {
+      // Next run time is calculated relative to the time when the worker
+      // was expected to be invoked. Missed periods are run back-to-back
+      // until the co-routine has caught up.
+      catchUpBurst,
+      // Like 'catchUpBurst' but missed periods are skipped so the next run
+      // is the first one on the original phase grid not yet passed.
+      catchUpSkip,
+      // Next run time is calculated relative to the time when the worker
+      // exited. No periods are ever missed.
+      catchUpRelativeToExit
+    };
+
   private:
-    bool suspended;
-    const bool waitRelativeToWorkerExit;
-    unsigned long nextRun;
+#ifdef CoRoutinesShortDeadlines
+    typedef uint16_t TimeStamp;
+    typedef int16_t TimeDifference;
+#else
+    typedef unsigned long TimeStamp;
+#endif
+
+    // Flags packed into a single byte.
+    unsigned char suspended : 1;
+    unsigned char asap : 1;           // Run as soon as possible ignoring 'nextRun'.
+    unsigned char catchUpPolicy : 2;
+
+#ifndef CoRoutinesNoWatchdog
+    unsigned char overrunLimit;       // Overruns in a row before suspending.
+    unsigned char overrunsInARow;
+#endif
+
+    TimeStamp nextRun;
+    TimeStamp period;                 // Last wait time returned by the worker.
+    unsigned int slack;               // Acceptable delay of each run.
+    unsigned int missedPeriods;
+
+#ifndef CoRoutinesNoWatchdog
+    // Overrun watchdog.
+    unsigned int maxRunTime;          // Budget in milliseconds (0 means none).
+    unsigned int longestRunTime;
+    unsigned int overrunCount;
+#endif
+
+#ifdef CoRoutinesHost
+    unsigned long simulatedRunTime;
+    unsigned long workerTime;         // Microseconds, see 'getWorkerTime()'.
+#endif
+
+    // The scheduler mirroring the state of this co-routine (0 if none.)
+    Scheduler* owner;
+    size_t ownerSlot;
+
+    // Tell the owner that 'nextRun' or 'suspended' has changed.
+    void changed();
+
+    // Returns 'true' iff the next run time has been reached at 'now'.
+    bool isDue(unsigned long now);
+
+    // Returns the next run time in full as seen from 'now'.
+    // Returns 'now' if the co-routine should run as soon as possible.
+    unsigned long getNextRun(unsigned long now);
+
+    // Set the next run time.
+    void setNextRun(unsigned long time);
     
   protected:
     // Override to implement what the co-routine should do.
@@ -96,6 +386,21 @@ namespace coroutines {
     // 0 means as soon as possible.
     // -1 indicates that the co-routine should be suspended and no longer run.
     virtual int worker() = 0;
+
+    // Called by 'resume()' to run the worker. Returns what to do next.
+    // The default implementation calls 'worker()' and translates its
+    // wait time.
+    virtual Next work();
+
+    // Awake the co-routine if suspended and set its next run time to 'time'.
+    void wakeAt(unsigned long time);
+
+#ifndef CoRoutinesNoWatchdog
+    // Called when the worker has exceeded the maximum run time set by
+    // 'setMaxRunTime()'. 'runTime' is the time the worker actually took.
+    // Override to be notified. The default implementation does nothing.
+    virtual void overrun(unsigned long runTime);
+#endif
     
   public:
     // Create a co-routine.
@@ -111,11 +416,20 @@ namespace coroutines {
     //       If 'true' the next run time is calculated relative to the time when
     //     when the worker exited.
     CoRoutine(bool waitRelativeToWorkerExit = false);
+
+    // Create a co-routine using the given catch-up policy.
+    // 'CoRoutine(false)' is the same as 'CoRoutine(catchUpBurst)' and
+    // 'CoRoutine(true)' is the same as 'CoRoutine(catchUpRelativeToExit)'.
+    CoRoutine(CatchUpPolicy catchUpPolicy);
+
+    // A co-routine destroyed while member of a scheduler is removed from it.
+    virtual ~CoRoutine();
     
     // Call this whenever the routine can have a time slot.
     // If it is time for the co-routine to run, 'worker()' will be called.
     // Otherwise, nothing happens.
-    void resume();
+    // Returns 'true' iff the worker was invoked.
+    bool resume();
     
     // Returns 'true' iff the co-routine is suspended.
     bool isSuspended();
@@ -125,37 +439,515 @@ namespace coroutines {
 
     // Call this to suspend the co-routine.
     void suspend();
+
+    // Make a co-routine waiting for its next run due right away.
+    // Unlike 'awake()' this does not affect a suspended co-routine.
+    void wakeNow();
+
+    // Run the co-routine as soon as possible whether it is suspended or
+    // waiting, e.g. for a timeout. Used when an event a co-routine may be
+    // waiting for with or without a timeout has happened.
+    void resumeNow();
+
+    // Returns the period of the co-routine which is the last wait time
+    // returned by the worker (0 if it has not been invoked yet.)
+    unsigned long getPeriod();
+
+    // Declare the period of the co-routine before it is invoked the first
+    // time. Used by the scheduler when staggering phases.
+    void setPeriod(unsigned long period);
+
+    // Set the number of milliseconds the co-routine may be invoked later
+    // than it asked for. Allows the scheduler to invoke it together with
+    // other co-routines to save wakeups. Default is 0.
+    void setSlack(unsigned int slack);
+
+    // Returns the slack set by 'setSlack()'.
+    unsigned int getSlack();
+
+    // Returns the catch-up policy of this co-routine.
+    CatchUpPolicy getCatchUpPolicy();
+
+    // Returns the number of periods that were due before the worker
+    // exited. With 'catchUpBurst' these are run late, with 'catchUpSkip'
+    // they are skipped.
+    unsigned int getMissedPeriods();
+
+#ifndef CoRoutinesNoWatchdog
+    // Declare the maximum time in milliseconds the worker is expected to run
+    // per invocation. 0 (default) disables the check.
+    // If 'suspendAfter' is non-zero the co-routine is suspended when the
+    // worker has overrun its budget 'suspendAfter' times in a row.
+    void setMaxRunTime(unsigned int maxRunTime, unsigned char suspendAfter = 0);
+
+    // Returns the maximum run time set by 'setMaxRunTime()'.
+    unsigned int getMaxRunTime();
+
+    // Returns the longest time in milliseconds the worker has run.
+    unsigned int getLongestRunTime();
+
+    // Returns the number of times the worker has exceeded its maximum run time.
+    unsigned int getOverrunCount();
+
+    // Reset the longest run time and the overrun counters.
+    void resetOverruns();
+#endif
+
+#ifdef CoRoutinesHost
+    // Set the time in milliseconds a simulated clock should let pass
+    // whenever the worker is invoked. Ignored by the system clock.
+    void setSimulatedRunTime(unsigned long runTime);
+
+    // Returns the time set by 'setSimulatedRunTime()'.
+    unsigned long getSimulatedRunTime();
+
+    // Returns the total time in microseconds spent in the worker while run
+    // by a scheduler timing its workers (see 'Scheduler::setTimeWorkers()'.)
+    // Can be called by any thread.
+    unsigned long getWorkerTime();
+#endif
+
+    friend class Scheduler;
+  };
+
+
+  // A co-routine whose worker is not limited to wait times fitting an 'int'.
+  class LongWaitCoRoutine : public CoRoutine
+  {
+  private:
+    // Not used as 'work()' is overridden.
+    virtual int worker();
+
+  protected:
+    // Override to implement what the co-routine should do.
+    // Returns what to do next, e.g. 'Next::after(3600000UL)'.
+    virtual Next work() = 0;
+
+  public:
+    // Create a co-routine, see 'CoRoutine'.
+    LongWaitCoRoutine(CatchUpPolicy catchUpPolicy = catchUpBurst);
+  };
+
+
+  class Timer;
+  class CoRoutineGroup;
+
+  // A function called when a timer fires.
+  typedef void (*TimerCallback)(void* context);
+
+  // Counts how many times a slot of a scheduler or a timer has been
+  // reused. A handle stays stale until the counter wraps around.
+#ifdef CoRoutinesHost
+  typedef uint32_t Generation;
+#else
+  typedef uint16_t Generation;
+#endif
+
+  // Identifies a timer started by Scheduler::callAfter() or callEvery().
+  struct TimerHandle
+  {
+    unsigned char index;      // Index into the pool of timers.
+    Generation generation;    // Detects handles of timers that have ended.
+
+    // Returns 'false' if no timer was available when starting the timer.
+    bool isValid() const;
+  };
+
+
+  // Identifies a co-routine added to a scheduler.
+  struct CoRoutineHandle
+  {
+    size_t index;             // Index of the slot in the scheduler.
+    Generation generation;    // Detects handles of removed co-routines.
+
+    // Returns 'false' for the handle of no co-routine.
+    bool isValid() const;
   };
 
 
   // A scheduler for co-routines.
   class Scheduler
   {
+  protected:
+    struct Entry
+    {
+      CoRoutine* coRoutine;   // 0 if removed while running.
+      size_t slot;
+    };
+
+    // Bits of the state of an entry.
+    enum
+    {
+      stateSuspended = 1,
+      stateRemoved = 2
+    };
+
+    // Words of the bitmap of ready entries. Bit 'i % readyBits' of word
+    // 'i / readyBits' is set when entry 'i' is ready to run.
+#ifdef CoRoutinesHost
+    typedef uint64_t ReadyWord;
+#else
+    typedef uint8_t ReadyWord;
+#endif
+    enum
+    {
+      readyBits = 8 * sizeof(ReadyWord)
+    };
+
+    // Handles refer to slots which refer to entries. The slots never move.
+    // A free slot refers to the next free slot instead.
+    struct Slot
+    {
+      size_t entry;
+      size_t pending;         // Index into 'pending' or 'notPending'.
+      Generation generation;
+    };
+
+    // A co-routine waiting for its next run time.
+    struct Pending
+    {
+      uint32_t deadline;      // Next run time.
+      unsigned int slack;     // See 'CoRoutine::setSlack()'.
+      size_t slot;
+    };
+
+    // Use the given arrays of 'capacity' entries and never allocate memory.
+    // 'ready' must have room for 'capacity' bits.
+    Scheduler(Entry* entries, Slot* slots, Pending* pending, unsigned char* groups,
+              unsigned char* states, ReadyWord* ready, size_t capacity);
+
   private:
-    CoRoutine** coRoutines; // An array of pointers to co-routines.
+    enum
+    {
+      notPending = (size_t) -1
+    };
+
+    Entry* entries; // A dense array of co-routines.
+    Slot* slots;    // An array of the same size as 'entries'.
+
+    // Arrays parallel to 'entries' mirroring the co-routines, so the
+    // scheduler does not touch co-routines which are not due.
+    unsigned char* groups;  // Groups of each co-routine.
+    unsigned char* states;  // 'stateSuspended' and 'stateRemoved' bits.
+
+    // Co-routines neither ready nor suspended wait in 'pending', a binary
+    // min-heap ordered by deadline. A run moves those whose deadlines have
+    // been reached to 'ready' and only visits the entries marked there.
+    Pending* pending;
+    size_t noPending;
+    ReadyWord* ready;
+    size_t readyCount;
+    uint32_t tickTime;      // Time of the current or last run.
+    
+    // Earliest latest run time of an active pending entry, if 'waiting'.
+    // Found when needed if not 'wakeupKnown'.
+    uint32_t nextWakeup;
+    bool waiting;
+    bool wakeupKnown;
     size_t arraySize;
+    bool growable;          // The arrays are allocated by 'resize()' as
+                            // a single block starting with 'ready'.
     size_t noEntries;
+    size_t freeSlots;       // First free slot. 'arraySize' if none.
+    bool running;           // Entries are not moved while running.
+    bool removedWhileRunning;
+    unsigned char suspendedGroups;
+    bool autoStagger;
+    bool staggerPending;    // Periods added, removed or set since last stagger.
+    bool staggerRequested;  // 'staggerPhases()' was called while running.
+#ifdef CoRoutinesHost
+    bool timeWorkers;
+#endif
+
+    // Statistics on the number of workers invoked per run.
+    unsigned long wakeups;    // All runs.
+    unsigned long busyTicks;  // Runs invoking at least one worker.
+    unsigned long totalWork;  // Workers invoked in all runs.
+    size_t peakWork;          // Maximum workers invoked in a single run.
+
+    // The group running this scheduler, if any.
+    CoRoutineGroup* group;
+
+    // Pool of timers for 'callAfter()' and 'callEvery()'.
+    Timer* timers;
+    unsigned char noTimers;
+    Timer* freeTimers;        // Linked list of timers not in use.
+
+    TimerHandle startTimer(unsigned int delay, unsigned int interval,
+                           TimerCallback callback, void* context);
+    void releaseTimer(Timer& timer);
+
+    // Returns 'true' iff 'coRoutine' is a timer of the pool. Timers not in
+    // use are suspended but must stay in the scheduler.
+    bool isTimer(CoRoutine& coRoutine);
     
-    void resize(size_t newSize);
+    // Make sure the arrays have room for 'newSize' entries.
+    // Returns 'false' if they are full and cannot grow.
+    bool resize(size_t newSize);
+
+    // Copy the next run time and state of the co-routine at 'index'.
+    void mirror(size_t index);
+
+    // Called by a co-routine of this scheduler when its state has changed.
+    void coRoutineChanged(CoRoutine& coRoutine);
+
+    // Make the group running this scheduler due no later than 'latestRun'
+    // (or right away if 'ready') unless this scheduler is running.
+    void wakeGroup(bool ready, uint32_t latestRun);
+
+    // Move the entry at 'from' to 'to' which must be free.
+    void moveEntry(size_t from, size_t to);
+
+    // Mark entries as ready or not ready to run.
+    void setReady(size_t index);
+    void clearReady(size_t index);
+    bool isReady(size_t index);
+
+    // Make the entry of 'slot' pending with the given deadline and slack,
+    // or update them if it is pending already. Takes O(log n) time.
+    void schedule(size_t slot, uint32_t deadline, unsigned int slack);
+
+    // Make the entry of 'slot' no longer pending if it is.
+    void unschedule(size_t slot);
+
+    // Put 'node' at 'index' of 'pending' and move it up or down the heap
+    // until it is in order.
+    void placePendingUp(size_t index, Pending node);
+    void placePendingDown(size_t index, Pending node);
+
+    // Mark the pending entries due at 'tickTime' as ready to run.
+    void markDue();
+
+    // Find 'nextWakeup' among the pending entries. Only visits entries
+    // whose deadlines are earlier than the result.
+    void findWakeup();
+
+    // Returns the entry of 'handle' or 0 if the handle is stale.
+    Entry* findEntry(CoRoutineHandle handle);
+
+    // Remove the entry at 'index'.
+    void removeEntry(size_t index);
+
+    // Move the last entry into the entries removed while running.
+    void compact();
+
+    // Returns 'true' iff the entry at 'index' is not removed and neither
+    // the co-routine nor any of its groups are suspended.
+    bool isActive(size_t index);
+
+    // Returns 'true' iff an entry not of a suspended group is ready.
+    bool hasActiveReady();
+
+    // Returns the period of the entry at 'index' if it is active or 0.
+    unsigned long staggerPeriod(size_t index);
+
+    // Exchange the entries at 'a' and 'b'.
+    void swapEntries(size_t a, size_t b);
+
+    // Sort the entries by 'staggerPeriod()' in place.
+    void siftDown(size_t root, size_t end);
+    void sortByPeriod();
     
   public:
     Scheduler();
     virtual ~Scheduler();
     
     // Add a co-routine to this scheduler.
-    // Note: Do not add tha same co-routine twice or it will be invoked two
-    //       times per run.
-    void addCoRoutine(CoRoutine& coRoutine);
+    // 'groups' is a bit mask of the groups the co-routine belongs to.
+    // Returns a handle identifying the co-routine in this scheduler or a
+    // handle that is not valid if there is no room for it.
+    // Note: A co-routine can be member of one scheduler at a time only.
+    //       Adding it twice or to more than one scheduler is rejected with
+    //       a handle that is not valid.
+    CoRoutineHandle addCoRoutine(CoRoutine& coRoutine, unsigned char groups = 0);
 
     // If the co-routine is not member of this scheduler, nothing happens.
-    // If a co-routine was added multiple times, it will only be removed once.
     void removeCoRoutine(CoRoutine& coRoutine);
 
+    // Remove the co-routine identified by 'handle' in constant time.
+    // Returns 'false' if the handle is stale.
+    bool removeCoRoutine(CoRoutineHandle handle);
+
+    // Returns the co-routine identified by 'handle' or 0 if the handle
+    // is stale.
+    CoRoutine* getCoRoutine(CoRoutineHandle handle);
+
+    // Awake the co-routine identified by 'handle'.
+    // Returns 'false' if the handle is stale.
+    bool awakeCoRoutine(CoRoutineHandle handle);
+
+    // Change the groups of a co-routine of this scheduler.
+    // If the co-routine is not member of this scheduler, nothing happens.
+    void setGroups(CoRoutine& coRoutine, unsigned char groups);
+
+    // Suspend all co-routines belonging to any of the groups in 'groups'.
+    // The co-routines are skipped by 'runOnce()' until their groups are
+    // awakened. Their own state is not changed.
+    void suspendGroup(unsigned char groups);
+
+    // Awake the groups in 'groups'. The co-routines of the groups continue
+    // according to their catch-up policy (unless they belong to other
+    // groups which are still suspended.)
+    void awakeGroup(unsigned char groups);
+
+    // Returns the mask of suspended groups.
+    unsigned char getSuspendedGroups();
+
     // Call 'resume' on all co-routines of this scheduler once.
     // Set 'removeSuspendedCoRoutines' to 'true' to automatically remove
-    // suspended co-routines from this scheduler.
+    // suspended co-routines from this scheduler. The timers given to
+    // 'setTimers()' are never removed.
     // Using this feature imposes a slight overhead in the scheduler.
-    void runOnce(bool removeSuspendedCoRoutines = false);
+    virtual void runOnce(bool removeSuspendedCoRoutines = false);
+
+#ifndef CoRoutinesNoWatchdog
+    // Returns the total number of overruns of all co-routines
+    // of this scheduler.
+    unsigned long getOverrunCount();
+#endif
+
+    // Spread the next run times of co-routines sharing the same period
+    // evenly across that period. Suspended co-routines and co-routines
+    // with period 0 are not touched. No co-routine is moved to run earlier
+    // than the earliest co-routine of its period would have run.
+    // The co-routines are sorted by period, which changes the order in
+    // which they are resumed. Takes O(n log n) time.
+    // Can be called at any time to rebalance the phases. Called from a
+    // worker it takes effect at the start of the next run.
+    void staggerPhases();
+
+    // If 'true', 'staggerPhases()' is called automatically by 'runOnce()'
+    // whenever co-routines with a period have been added or removed, or a
+    // co-routine has got its first period. Default is 'false'.
+    void setAutoStagger(bool autoStagger);
+
+#ifdef CoRoutinesHost
+    // If 'true', 'runOnce()' measures the time spent in each worker,
+    // see 'CoRoutine::getWorkerTime()'. Default is 'false'.
+    void setTimeWorkers(bool timeWorkers);
+#endif
+
+    // Returns the maximum number of workers invoked in a single run.
+    size_t getPeakTickWork();
+
+    // Returns the mean number of workers invoked in runs invoking any
+    // worker at all.
+    float getMeanTickWork();
+
+    // Reset the statistics on workers invoked per run.
+    void resetTickStats();
+
+    // Returns the time (as returned by 'currentTime()') at which 'runOnce()'
+    // should be called next, taking the slack of each co-routine into
+    // account. Returns the largest possible time if all co-routines
+    // are suspended.
+    virtual unsigned long getNextWakeup();
+
+    // Returns the number of milliseconds until 'getNextWakeup()' but no
+    // more than 'maxTime'. 0 means 'runOnce()' should be called right away.
+    // Without 'maxTime' this is practically forever if all co-routines
+    // are suspended.
+    unsigned long getTimeToNextWakeup(unsigned long maxTime = (unsigned long) -1);
+
+    // Returns the number of runs, i.e. calls of 'runOnce()', including
+    // runs that invoked no worker.
+    unsigned long getWakeupCount();
+
+    // Returns the mean number of workers invoked per run. When sleeping
+    // until 'getNextWakeup()' between runs this tells how well the slack
+    // of the co-routines allows wakeups to be coalesced. Runs invoking no
+    // worker, e.g. when woken early, lower the ratio.
+    float getCoalescingRatio();
+
+    // Use the 'noTimers' timers of the array 'timers' for 'callAfter()' and
+    // 'callEvery()'. The timers are added to this scheduler as co-routines
+    // of the groups 'groups'. Call this once only.
+    // Returns the number of timers added. Timers not added for lack of
+    // room are never used.
+    unsigned char setTimers(Timer* timers, unsigned char noTimers, unsigned char groups = 0);
+
+    // Call 'callback' with 'context' once in 'delay' milliseconds.
+    // Returns a handle that is not valid if all timers are in use.
+    TimerHandle callAfter(unsigned int delay, TimerCallback callback, void* context = 0);
+
+    // Call 'callback' with 'context' every 'interval' milliseconds starting
+    // 'interval' milliseconds from now. 'interval' is a wait time as
+    // returned by a worker so it must not exceed the largest 'int'.
+    // Returns a handle that is not valid if all timers are in use.
+    TimerHandle callEvery(unsigned int interval, TimerCallback callback, void* context = 0);
+
+    // Stop the timer identified by 'handle'. Returns 'false' if the timer
+    // has already ended (or 'handle' is not valid.)
+    bool cancelTimer(TimerHandle handle);
+
+    friend class CoRoutine;
+    friend class Timer;
+    friend class CoRoutineGroup;
+  };
+
+
+  // A scheduler with room for 'capacity' co-routines inside the object.
+  // It never allocates memory.
+  template <size_t capacity>
+  class FixedScheduler : public Scheduler
+  {
+  private:
+    Entry entryStorage[capacity];
+    Slot slotStorage[capacity];
+    Pending pendingStorage[capacity];
+    unsigned char groupStorage[capacity];
+    unsigned char stateStorage[capacity];
+    ReadyWord readyStorage[(capacity + readyBits - 1) / readyBits];
+
+  public:
+    FixedScheduler()
+      : Scheduler(entryStorage, slotStorage, pendingStorage, groupStorage,
+                  stateStorage, readyStorage, capacity)
+    { }
+  };
+
+
+  // A timer of the pool given to 'Scheduler::setTimers()'.
+  class Timer : public CoRoutine
+  {
+  private:
+    Scheduler* scheduler;
+    TimerCallback callback;   // 0 if the timer is not in use.
+    void* context;
+    unsigned int interval;    // 0 for a timer firing only once.
+    Generation generation;
+    bool firing;
+    Timer* nextFree;
+    
+  protected:
+    // Calls the callback.
+    virtual int worker();
+    
+  public:
+    Timer();
+
+    friend class Scheduler;
+  };
+
+
+  // A co-routine running all co-routines of a scheduler.
+  class CoRoutineGroup : public CoRoutine
+  {
+  private:
+    Scheduler& scheduler;
+    
+  protected:
+    // Runs the scheduler once and waits until its next wakeup.
+    virtual int worker();
+    
+  public:
+    // Create a group of the co-routines of 'scheduler'. A scheduler can
+    // be run by one group only.
+    CoRoutineGroup(Scheduler& scheduler);
+    virtual ~CoRoutineGroup();
+
+    // Returns the scheduler of this group.
+    Scheduler& getScheduler();
   };
 
 } // end of namespace coroutines
@@ -0,0 +1,281 @@
+/*
+  Simple co-routine library for Arduino.
+  
+  Copyright 2011-2017 Martin Gamwell Dawids.
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+  For an overview of the functionality in this file,
+  please see the file "ConcurrentScheduler.h".
+*/
+
+#include <ConcurrentScheduler.h>
+
+#ifdef CoRoutinesHost
+
+#include <chrono>
+#include <stdint.h>
+#include <unistd.h>
+
+namespace coroutines {
+
+  // Returns the smallest power of 2 not less than 'size' (at least 2.)
+  static size_t powerOf2(size_t size)
+  {
+    size_t power = 2;
+    while (power < size)
+    {
+      power *= 2;
+    }
+    return power;
+  }
+
+  ConcurrentScheduler::ConcurrentScheduler(size_t queueSize)
+    : cells(0),
+      capacity(powerOf2(queueSize)),
+      enqueuePosition(0),
+      dequeuePosition(0),
+      dispatchThread(std::this_thread::get_id()),
+      wakeupFd(-1),
+      sleeping(false),
+      wakeRequested(false)
+  {
+    // A cell is free for the producer at the position equal to its
+    // sequence number.
+    cells = new Cell[capacity];
+    for (size_t i = 0; i != capacity; ++i)
+    {
+      cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  ConcurrentScheduler::~ConcurrentScheduler()
+  {
+    delete[] cells;
+  }
+
+  bool ConcurrentScheduler::post(CommandKind kind, CoRoutine& coRoutine, unsigned char groups,
+                                 std::atomic<bool>* done, bool* added)
+  {
+    // Claim a cell by moving the enqueue position past it.
+    size_t position = enqueuePosition.load(std::memory_order_relaxed);
+    Cell* cell;
+    for (;;)
+    {
+      cell = &cells[position & (capacity - 1)];
+      const size_t sequence = cell->sequence.load(std::memory_order_acquire);
+      if (sequence == position)
+      {
+        if (enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+        {
+          break;
+        }
+      }
+      else if (sequence < position)
+      {
+        // The cell still holds a command from the last round: full.
+        return false;
+      }
+      else
+      {
+        // Another thread claimed the cell.
+        position = enqueuePosition.load(std::memory_order_relaxed);
+      }
+    }
+
+    cell->kind = kind;
+    cell->coRoutine = &coRoutine;
+    cell->groups = groups;
+    cell->done = done;
+    cell->added = added;
+    
+    // Hand the cell to the dispatch thread.
+    cell->sequence.store(position + 1, std::memory_order_release);
+    wakeUp();
+    return true;
+  }
+
+  void ConcurrentScheduler::postAndWait(CommandKind kind, CoRoutine& coRoutine, unsigned char groups,
+                                        bool* added)
+  {
+    std::atomic<bool> done(false);
+    while (!post(kind, coRoutine, groups, &done, added))
+    {
+      std::this_thread::yield();
+    }
+    while (!done.load(std::memory_order_acquire))
+    {
+      std::this_thread::yield();
+    }
+  }
+
+  void ConcurrentScheduler::wakeUp()
+  {
+    // Either the dispatch thread sees the request before going to sleep
+    // or this thread sees that it sleeps.
+    wakeRequested.store(true, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (sleeping.load(std::memory_order_relaxed))
+    {
+      std::lock_guard<std::mutex> lock(sleepMutex);
+      wakeCondition.notify_one();
+    }
+    
+    const int fd = wakeupFd.load(std::memory_order_relaxed);
+    if (fd >= 0)
+    {
+      const uint64_t one = 1;
+      const ssize_t n = write(fd, &one, sizeof(one));
+      (void) n;
+    }
+  }
+
+  bool ConcurrentScheduler::hasCommands()
+  {
+    const Cell& cell = cells[dequeuePosition & (capacity - 1)];
+    return cell.sequence.load(std::memory_order_acquire) == dequeuePosition + 1;
+  }
+
+  void ConcurrentScheduler::applyCommands()
+  {
+    for (;;)
+    {
+      Cell& cell = cells[dequeuePosition & (capacity - 1)];
+      if (cell.sequence.load(std::memory_order_acquire) != dequeuePosition + 1)
+      {
+        // No more commands.
+        return;
+      }
+
+      const CommandKind kind = cell.kind;
+      CoRoutine& coRoutine = *cell.coRoutine;
+      const unsigned char groups = cell.groups;
+      std::atomic<bool>* const done = cell.done;
+      bool* const added = cell.added;
+      
+      // Free the cell for the producers of the next round.
+      cell.sequence.store(dequeuePosition + capacity, std::memory_order_release);
+      ++dequeuePosition;
+
+      switch (kind)
+      {
+      case commandAdd:
+        {
+          const bool valid = addCoRoutine(coRoutine, groups).isValid();
+          if (added != 0)
+          {
+            *added = valid;
+          }
+        }
+        break;
+      case commandRemove:
+        removeCoRoutine(coRoutine);
+        break;
+      case commandAwake:
+        coRoutine.awake();
+        break;
+      }
+      
+      // The waiting thread may destroy the co-routine from now.
+      if (done != 0)
+      {
+        done->store(true, std::memory_order_release);
+      }
+    }
+  }
+
+  void ConcurrentScheduler::runOnce(bool removeSuspendedCoRoutines)
+  {
+    dispatchThread.store(std::this_thread::get_id(), std::memory_order_relaxed);
+    applyCommands();
+    Scheduler::runOnce(removeSuspendedCoRoutines);
+  }
+
+  unsigned long ConcurrentScheduler::getNextWakeup()
+  {
+    return (hasCommands() ? currentTime() : Scheduler::getNextWakeup());
+  }
+
+  void ConcurrentScheduler::waitForWakeup(unsigned long maxTime)
+  {
+    std::unique_lock<std::mutex> lock(sleepMutex);
+    sleeping.store(true, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    
+    // A command posted or a wake up requested from now on notifies the
+    // condition.
+    const unsigned long time = (wakeRequested.load(std::memory_order_relaxed) ? 0 : getTimeToNextWakeup(maxTime));
+    if (time >= 0x7FFFFFFF)
+    {
+      // Nothing due in the foreseeable future.
+      wakeCondition.wait(lock);
+    }
+    else if (time != 0)
+    {
+      wakeCondition.wait_for(lock, std::chrono::milliseconds(time));
+    }
+    sleeping.store(false, std::memory_order_relaxed);
+    
+    // The caller runs or checks its own state next, which covers requests
+    // made while sleeping.
+    wakeRequested.store(false, std::memory_order_relaxed);
+  }
+
+  void ConcurrentScheduler::setDispatchThread(std::thread::id thread)
+  {
+    dispatchThread.store(thread, std::memory_order_relaxed);
+  }
+
+  void ConcurrentScheduler::setWakeupFd(int fd)
+  {
+    wakeupFd.store(fd, std::memory_order_relaxed);
+  }
+
+  bool ConcurrentScheduler::addConcurrently(CoRoutine& coRoutine, unsigned char groups)
+  {
+    return post(commandAdd, coRoutine, groups, 0, 0);
+  }
+
+  bool ConcurrentScheduler::addConcurrentlyAndWait(CoRoutine& coRoutine, unsigned char groups)
+  {
+    if (std::this_thread::get_id() == dispatchThread.load(std::memory_order_relaxed))
+    {
+      // Nothing runs concurrently with the dispatch thread itself.
+      return addCoRoutine(coRoutine, groups).isValid();
+    }
+
+    bool added = false;
+    postAndWait(commandAdd, coRoutine, groups, &added);
+    return added;
+  }
+
+  void ConcurrentScheduler::removeConcurrently(CoRoutine& coRoutine)
+  {
+    if (std::this_thread::get_id() == dispatchThread.load(std::memory_order_relaxed))
+    {
+      // Nothing runs concurrently with the dispatch thread itself.
+      removeCoRoutine(coRoutine);
+      return;
+    }
+    
+    postAndWait(commandRemove, coRoutine, 0, 0);
+  }
+
+  bool ConcurrentScheduler::awakeConcurrently(CoRoutine& coRoutine)
+  {
+    return post(commandAwake, coRoutine, 0, 0, 0);
+  }
+
+} // end of namespace coroutines
+
+#endif // CoRoutinesHost
@@ -0,0 +1,187 @@
+/*
+  Simple co-routine library for Arduino.
+  
+  Copyright 2011-2017 Martin Gamwell Dawids.
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+  ConcurrentScheduler (host builds only)
+  --------------------------------------
+  A Scheduler is not thread-safe. A ConcurrentScheduler is a scheduler run
+  by one thread (the dispatch thread) which other threads can add
+  co-routines to, remove co-routines from and awake co-routines of.
+
+  Such changes are posted to a lock-free queue of commands. The dispatch
+  thread applies the commands at the start of each run, so the arrays of
+  the scheduler are only ever touched by the dispatch thread and it never
+  takes a lock:
+
+    ConcurrentScheduler scheduler(64);
+
+    // Dispatch thread.
+    for (;;)
+    {
+      scheduler.runOnce();
+      scheduler.waitForWakeup();
+    }
+
+    // Any other thread.
+    scheduler.addConcurrently(coRoutine);
+    ...
+    scheduler.removeConcurrently(coRoutine);
+
+  ConcurrentScheduler::removeConcurrently() waits until the dispatch thread
+  has removed the co-routine, so the co-routine can be destroyed when it
+  returns. ConcurrentScheduler::addConcurrentlyAndWait() likewise waits
+  and tells whether the co-routine was added. Called by the dispatch
+  thread itself (e.g. from a worker) they apply the change right away.
+  Until runOnce() is called the first time (or setDispatchThread() is
+  called), the thread which created the scheduler is taken to be the
+  dispatch thread.
+
+  While commands wait to be applied, getNextWakeup() returns the current
+  time. A dispatch thread sleeping between runs must be woken when a
+  command is posted: ConcurrentScheduler::waitForWakeup() sleeps until the
+  next wakeup, until a command is posted or until another thread calls
+  ConcurrentScheduler::wakeUp(). An EventLoop running a ConcurrentScheduler
+  wakes up through an 'eventfd' written on each post.
+
+  All other methods, including those inherited from Scheduler, must only
+  be called by the dispatch thread. A co-routine added concurrently must
+  only be changed by the dispatch thread, e.g. by its own worker.
+ */
+
+#ifndef __coroutines_concurrentscheduler_h__
+#define __coroutines_concurrentscheduler_h__
+
+#include <CoRoutines.h>
+
+#ifdef CoRoutinesHost
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+namespace coroutines {
+
+  // A scheduler accepting changes from other threads.
+  class ConcurrentScheduler : public Scheduler
+  {
+  private:
+    enum CommandKind
+    {
+      commandAdd,
+      commandRemove,
+      commandAwake
+    };
+
+    // A cell of the command queue. 'sequence' tells whether the cell is
+    // free for a producer or holds a command for the dispatch thread.
+    struct Cell
+    {
+      std::atomic<size_t> sequence;
+      CommandKind kind;
+      CoRoutine* coRoutine;
+      unsigned char groups;
+      std::atomic<bool>* done;  // Set when applied (0 if nobody waits.)
+      bool* added;              // Result of an add (0 if nobody waits.)
+    };
+
+    Cell* cells;
+    const size_t capacity;    // A power of 2.
+    std::atomic<size_t> enqueuePosition;
+    size_t dequeuePosition;
+    std::atomic<std::thread::id> dispatchThread;
+
+    // Waking the dispatch thread when a command is posted.
+    std::atomic<int> wakeupFd;      // Written on each post (-1 if none.)
+    std::atomic<bool> sleeping;     // In 'waitForWakeup()'.
+    std::atomic<bool> wakeRequested;
+    std::mutex sleepMutex;
+    std::condition_variable wakeCondition;
+
+    // Returns 'false' if the queue is full.
+    bool post(CommandKind kind, CoRoutine& coRoutine, unsigned char groups,
+              std::atomic<bool>* done, bool* added);
+
+    // Post a command and wait until the dispatch thread has applied it.
+    void postAndWait(CommandKind kind, CoRoutine& coRoutine, unsigned char groups,
+                     bool* added);
+
+    // Apply the commands posted so far.
+    void applyCommands();
+
+    // Returns 'true' iff a command has been posted but not applied.
+    bool hasCommands();
+
+  public:
+    // Create a scheduler with room for 'queueSize' commands not yet
+    // applied. 'queueSize' is rounded up to a power of 2.
+    ConcurrentScheduler(size_t queueSize = 64);
+    virtual ~ConcurrentScheduler();
+
+    // Apply the commands posted by other threads and run the co-routines
+    // once. The thread calling this is the dispatch thread.
+    virtual void runOnce(bool removeSuspendedCoRoutines = false);
+
+    // Returns the current time while commands wait to be applied.
+    virtual unsigned long getNextWakeup();
+
+    // Sleep until 'getNextWakeup()', until another thread posts a command
+    // or calls 'wakeUp()' or for at most 'maxTime' milliseconds, whichever
+    // comes first.
+    void waitForWakeup(unsigned long maxTime = (unsigned long) -1);
+
+    // Make the dispatch thread return from 'waitForWakeup()' (or wake up
+    // its EventLoop) without posting a command. If it is not sleeping,
+    // its next call to 'waitForWakeup()' returns right away.
+    // Can be called by any thread.
+    void wakeUp();
+
+    // Make 'thread' the dispatch thread before it calls 'runOnce()' the
+    // first time, e.g. right after starting it.
+    void setDispatchThread(std::thread::id thread);
+
+    // Write 1 to the 'eventfd' 'fd' whenever a command is posted, so a
+    // dispatch thread sleeping in 'poll()' or 'epoll_wait()' wakes up.
+    // -1 (default) for none. Used by EventLoop.
+    void setWakeupFd(int fd);
+
+    // Add 'coRoutine' to this scheduler in the next run.
+    // Returns 'false' if the queue of commands is full.
+    // Can be called by any thread.
+    bool addConcurrently(CoRoutine& coRoutine, unsigned char groups = 0);
+
+    // Add 'coRoutine' to this scheduler. Returns when it has been added
+    // which requires the dispatch thread to run. Returns 'false' if the
+    // scheduler could not add it, see Scheduler::addCoRoutine().
+    // Can be called by any thread.
+    bool addConcurrentlyAndWait(CoRoutine& coRoutine, unsigned char groups = 0);
+
+    // Remove 'coRoutine' from this scheduler. Returns when it has been
+    // removed which requires the dispatch thread to run.
+    // Can be called by any thread.
+    void removeConcurrently(CoRoutine& coRoutine);
+
+    // Awake 'coRoutine' in the next run.
+    // Returns 'false' if the queue of commands is full.
+    // Can be called by any thread.
+    bool awakeConcurrently(CoRoutine& coRoutine);
+  };
+
+} // end of namespace coroutines
+
+#endif // CoRoutinesHost
+
+#endif // __coroutines_concurrentscheduler_h__
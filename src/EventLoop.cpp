@@ -0,0 +1,204 @@
+/*
+  Simple co-routine library for Arduino.
+  
+  Copyright 2011-2017 Martin Gamwell Dawids.
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+  For an overview of the functionality in this file,
+  please see the file "EventLoop.h".
+*/
+
+#include <EventLoop.h>
+
+#if defined(CoRoutinesHost) && defined(__linux__)
+
+#include <ConcurrentScheduler.h>
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+namespace coroutines {
+
+  EventLoop::EventLoop(Scheduler& scheduler)
+    : scheduler(scheduler),
+      concurrentScheduler(0),
+      epollFd(epoll_create1(EPOLL_CLOEXEC)),
+      timerFd(timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)),
+      wakeupFd(-1),
+      stopped(false)
+  {
+    start();
+  }
+
+  EventLoop::EventLoop(ConcurrentScheduler& scheduler)
+    : scheduler(scheduler),
+      concurrentScheduler(&scheduler),
+      epollFd(epoll_create1(EPOLL_CLOEXEC)),
+      timerFd(timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)),
+      wakeupFd(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)),
+      stopped(false)
+  {
+    start();
+  }
+
+  void EventLoop::start()
+  {
+    if (epollFd < 0)
+    {
+      return;
+    }
+    
+    // The timer is told apart from file descriptors by having no
+    // co-routine, the 'eventfd' by pointing to the loop.
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    if (timerFd >= 0)
+    {
+      event.data.ptr = 0;
+      epoll_ctl(epollFd, EPOLL_CTL_ADD, timerFd, &event);
+    }
+    if (wakeupFd >= 0)
+    {
+      event.data.ptr = this;
+      epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeupFd, &event);
+      concurrentScheduler->setWakeupFd(wakeupFd);
+    }
+  }
+
+  EventLoop::~EventLoop()
+  {
+    if (wakeupFd >= 0)
+    {
+      concurrentScheduler->setWakeupFd(-1);
+      close(wakeupFd);
+    }
+    if (timerFd >= 0)
+    {
+      close(timerFd);
+    }
+    if (epollFd >= 0)
+    {
+      close(epollFd);
+    }
+  }
+
+  bool EventLoop::isValid()
+  {
+    return epollFd >= 0 && timerFd >= 0 && (concurrentScheduler == 0 || wakeupFd >= 0);
+  }
+
+  bool EventLoop::wait(int fd, unsigned int events, CoRoutine& coRoutine)
+  {
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = events | EPOLLONESHOT;
+    event.data.ptr = &coRoutine;
+    
+    // A file descriptor waited for before stays registered (but disabled.)
+    if (epoll_ctl(epollFd, EPOLL_CTL_MOD, fd, &event) == 0)
+    {
+      return true;
+    }
+    return errno == ENOENT && epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) == 0;
+  }
+
+  bool EventLoop::waitReadable(int fd, CoRoutine& coRoutine)
+  {
+    return wait(fd, EPOLLIN | EPOLLRDHUP, coRoutine);
+  }
+
+  bool EventLoop::waitWritable(int fd, CoRoutine& coRoutine)
+  {
+    return wait(fd, EPOLLOUT, coRoutine);
+  }
+
+  void EventLoop::cancelWait(int fd)
+  {
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, 0);
+  }
+
+  void EventLoop::runOnce(int maxWait)
+  {
+    scheduler.runOnce();
+    
+    // Sleep until the next wakeup of the scheduler.
+    const unsigned long timeToWakeup = scheduler.getTimeToNextWakeup();
+    int timeout = -1;
+    if (timeToWakeup == 0 || stopped)
+    {
+      // Something is due already or we are stopping.
+      // Just pick up pending events.
+      timeout = 0;
+    }
+    else if (scheduler.getNextWakeup() != (unsigned long) -1)
+    {
+      struct itimerspec spec;
+      memset(&spec, 0, sizeof(spec));
+      spec.it_value.tv_sec = timeToWakeup / 1000;
+      spec.it_value.tv_nsec = (timeToWakeup % 1000) * 1000000L;
+      timerfd_settime(timerFd, 0, &spec, 0);
+    }
+    if (maxWait >= 0 && (timeout < 0 || maxWait < timeout))
+    {
+      timeout = maxWait;
+    }
+    
+    struct epoll_event events[16];
+    const int noEvents = epoll_wait(epollFd, events, 16, timeout);
+    for (int i = 0; i < noEvents; ++i)
+    {
+      CoRoutine* const coRoutine = (CoRoutine*) events[i].data.ptr;
+      if (coRoutine == 0)
+      {
+        // The timer expired. Read it to re-arm it.
+        uint64_t expirations;
+        const ssize_t n = read(timerFd, &expirations, sizeof(expirations));
+        (void) n;
+      }
+      else if (events[i].data.ptr == this)
+      {
+        // Commands were posted. They are applied by the next run.
+        uint64_t posts;
+        const ssize_t n = read(wakeupFd, &posts, sizeof(posts));
+        (void) n;
+      }
+      else
+      {
+        coRoutine->resumeNow();
+      }
+    }
+  }
+
+  void EventLoop::run()
+  {
+    stopped = false;
+    while (!stopped)
+    {
+      runOnce();
+    }
+  }
+
+  void EventLoop::stop()
+  {
+    stopped = true;
+  }
+
+} // end of namespace coroutines
+
+#endif // CoRoutinesHost && __linux__
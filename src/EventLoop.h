@@ -0,0 +1,125 @@
+/*
+  Simple co-routine library for Arduino.
+  
+  Copyright 2011-2017 Martin Gamwell Dawids.
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+  EventLoop (Linux host builds only)
+  ----------------------------------
+  An event loop makes a scheduler the main loop of a Linux process.
+  Instead of spinning on Scheduler::runOnce(), the event loop sleeps in
+  'epoll_wait()' until the next co-routine is due (using a 'timerfd' set to
+  the next wakeup of the scheduler) or until a file descriptor a
+  co-routine waits for becomes ready.
+
+  A co-routine waits for a file descriptor (a socket, a pipe, a serial
+  tty, ...) by calling EventLoop::waitReadable() or
+  EventLoop::waitWritable() and returning -1 from its worker. When the file
+  descriptor becomes ready the co-routine is awakened. A co-routine can
+  also wait with a timeout by returning the timeout instead of -1; it is
+  then invoked when either happens first.
+
+    EventLoop loop(scheduler);
+    ...
+    int worker()
+    {
+      char buffer[64];
+      const ssize_t n = read(fd, buffer, sizeof(buffer));
+      if (n < 0 && errno == EAGAIN)
+      {
+        loop.waitReadable(fd, *this);
+        return -1;
+      }
+      ...
+    }
+    ...
+    loop.run();
+
+  Waits are one-shot: the co-routine must wait again after being awakened.
+  Only one co-routine can wait for a file descriptor at a time. Close a
+  file descriptor only after calling EventLoop::cancelWait() for it.
+
+  An event loop can also run a ConcurrentScheduler. Commands posted by
+  other threads then wake the loop through an 'eventfd', so they are
+  applied right away even if no co-routine is due.
+ */
+
+#ifndef __coroutines_eventloop_h__
+#define __coroutines_eventloop_h__
+
+#include <CoRoutines.h>
+
+#if defined(CoRoutinesHost) && defined(__linux__)
+
+namespace coroutines {
+
+  class ConcurrentScheduler;
+
+  // A Linux event loop running a scheduler.
+  class EventLoop
+  {
+  private:
+    Scheduler& scheduler;
+    ConcurrentScheduler* const concurrentScheduler;
+    int epollFd;
+    int timerFd;
+    int wakeupFd;     // Written when a command is posted (-1 if none.)
+    bool stopped;
+    
+    // Register the timer and the 'eventfd' with the epoll instance.
+    void start();
+
+    bool wait(int fd, unsigned int events, CoRoutine& coRoutine);
+    
+  public:
+    // Create an event loop running 'scheduler'.
+    EventLoop(Scheduler& scheduler);
+
+    // Create an event loop running 'scheduler' which wakes up when other
+    // threads post commands to it.
+    EventLoop(ConcurrentScheduler& scheduler);
+    virtual ~EventLoop();
+
+    // Returns 'false' if the epoll instance, the timer or the 'eventfd'
+    // could not be created.
+    bool isValid();
+
+    // Awake 'coRoutine' when 'fd' becomes readable.
+    // Returns 'false' (and sets 'errno') if 'fd' cannot be waited for.
+    bool waitReadable(int fd, CoRoutine& coRoutine);
+
+    // Awake 'coRoutine' when 'fd' becomes writable.
+    // Returns 'false' (and sets 'errno') if 'fd' cannot be waited for.
+    bool waitWritable(int fd, CoRoutine& coRoutine);
+
+    // Stop waiting for 'fd'.
+    void cancelWait(int fd);
+
+    // Run the scheduler once, then sleep until a co-routine is due or
+    // awakened by a file descriptor. Never sleeps longer than 'maxWait'
+    // milliseconds (-1 for no limit.)
+    void runOnce(int maxWait = -1);
+
+    // Call 'runOnce()' until 'stop()' is called.
+    void run();
+
+    // Make 'run()' return after the current run.
+    void stop();
+  };
+
+} // end of namespace coroutines
+
+#endif // CoRoutinesHost && __linux__
+
+#endif // __coroutines_eventloop_h__
@@ -0,0 +1,188 @@
+/*
+  Simple co-routine library for Arduino.
+  
+  Copyright 2011-2017 Martin Gamwell Dawids.
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+  Futures
+  -------
+  A co-routine often computes a value another co-routine needs. Instead of
+  letting the consumer poll a flag set by the producer, the producer keeps
+  a Promise and the consumer awaits the Future of it:
+
+    class Measure : public CoRoutine
+    {
+    public:
+      Promise<int> temperature;
+      ...
+      int worker()
+      {
+        ...
+        temperature.set(value);
+        ...
+      }
+    };
+
+    class Publish : public CoRoutine
+    {
+      Future<int> temperature;
+      ...
+      int worker()
+      {
+        if (!temperature.await(*this))
+        {
+          return -1;
+        }
+        ... temperature.get() ...
+        measure.temperature.reset();
+        return 0;
+      }
+    };
+
+  A co-routine awaiting a future not yet ready is parked and its worker
+  should return -1 (or a timeout.) Setting the promise awakes it once.
+
+  The value is kept inside the promise, so nothing is allocated. 'T' must
+  have a default constructor and an assignment operator. The promise must
+  live as long as its futures. Only one co-routine can await a promise at
+  a time. A promise is set once; call Promise::reset() to use it again.
+ */
+
+#ifndef __coroutines_future_h__
+#define __coroutines_future_h__
+
+#include <CoRoutines.h>
+
+namespace coroutines {
+
+  template <class T> class Future;
+
+  // A value set by one co-routine for another.
+  template <class T>
+  class Promise
+  {
+  private:
+    T value;
+    bool ready;
+    CoRoutine* waiter;        // The co-routine awaiting the value, if any.
+
+  public:
+    Promise()
+      : value(),
+        ready(false),
+        waiter(0)
+    { }
+
+    // Returns a future of the value of this promise.
+    Future<T> getFuture()
+    {
+      return Future<T>(*this);
+    }
+
+    // Set the value and awake the co-routine awaiting it.
+    // Returns 'false' if the value has been set already.
+    bool set(const T& value)
+    {
+      if (ready)
+      {
+        return false;
+      }
+      this->value = value;
+      ready = true;
+      if (waiter != 0)
+      {
+        CoRoutine* const coRoutine = waiter;
+        waiter = 0;
+        coRoutine->resumeNow();
+      }
+      return true;
+    }
+
+    // Returns 'true' iff the value has been set.
+    bool isReady()
+    {
+      return ready;
+    }
+
+    // Make the value unset again, e.g. for the next round. A co-routine
+    // awaiting the value keeps awaiting it.
+    void reset()
+    {
+      ready = false;
+    }
+
+    friend class Future<T>;
+  };
+
+
+  // The value of a promise, once set.
+  template <class T>
+  class Future
+  {
+  private:
+    Promise<T>* promise;
+
+  public:
+    // Create a future of no promise. Assign a future of a promise to it
+    // before use.
+    Future()
+      : promise(0)
+    { }
+
+    // Create a future of the value of 'promise'.
+    Future(Promise<T>& promise)
+      : promise(&promise)
+    { }
+
+    // Returns 'true' iff this is a future of a promise.
+    bool isValid()
+    {
+      return promise != 0;
+    }
+
+    // Returns 'true' iff the value has been set.
+    bool isReady()
+    {
+      return promise->ready;
+    }
+
+    // Returns 'true' if the value has been set. Otherwise 'coRoutine'
+    // awaits it: it is awakened when the value is set, and its worker
+    // should return -1 (or a timeout) now.
+    bool await(CoRoutine& coRoutine)
+    {
+      if (promise->ready)
+      {
+        return true;
+      }
+      promise->waiter = &coRoutine;
+      return false;
+    }
+
+    // Stop awaiting the value, e.g. after a timeout.
+    void cancel()
+    {
+      promise->waiter = 0;
+    }
+
+    // Returns the value. Only valid once the value has been set.
+    const T& get()
+    {
+      return promise->value;
+    }
+  };
+
+} // end of namespace coroutines
+
+#endif // __coroutines_future_h__
@@ -0,0 +1,177 @@
+/*
+  Simple co-routine library for Arduino.
+  
+  Copyright 2011-2017 Martin Gamwell Dawids.
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+  Generators
+  ----------
+  A generator is a co-routine producing a stream of values, one at a time,
+  for a consumer co-routine pulling them on demand. E.g. a long sensor
+  dump can be decoded record by record without holding all of it in RAM.
+
+  Derive the generator from Generator and implement generate(). It is
+  called whenever a value is wanted and either passes the next value to
+  produce(), calls finish() when there are no more values, or returns the
+  time to wait before trying again (like a worker):
+
+    class Records : public Generator<Record>
+    {
+      int generate()
+      {
+        if (dump.available() < sizeof(Record))
+        {
+          return 10;
+        }
+        ...
+        produce(record);
+        return 0;
+      }
+    };
+
+  The consumer calls Generator::next() from its worker. If no value is
+  available yet, the consumer waits for it: its worker should return -1
+  (or a timeout) and it is awakened when the value has been produced:
+
+    int worker()
+    {
+      Record record;
+      while (records.next(*this, record))
+      {
+        ...
+      }
+      return records.isFinished() ? 1000 : -1;
+    }
+
+  The generator starts out suspended and produces no more than one value
+  ahead of the consumer, which is kept inside the generator. Add both
+  co-routines to the same scheduler. Only one co-routine can consume from
+  a generator at a time.
+ */
+
+#ifndef __coroutines_generator_h__
+#define __coroutines_generator_h__
+
+#include <CoRoutines.h>
+
+namespace coroutines {
+
+  // A co-routine producing values of type 'T' for a consumer co-routine.
+  // 'T' must have a default constructor and an assignment operator.
+  template <class T>
+  class Generator : public CoRoutine
+  {
+  private:
+    T value;                  // The value produced but not yet consumed.
+    bool full;
+    bool finished;
+    CoRoutine* consumer;      // The co-routine waiting for a value, if any.
+
+    // Awake the consumer waiting, if any.
+    void awakeConsumer()
+    {
+      if (consumer != 0)
+      {
+        CoRoutine* const coRoutine = consumer;
+        consumer = 0;
+        coRoutine->resumeNow();
+      }
+    }
+
+    virtual int worker()
+    {
+      if (full || finished)
+      {
+        // Wait for the value to be consumed.
+        return -1;
+      }
+      const int wait = generate();
+      return full || finished ? -1 : wait;
+    }
+
+  protected:
+    // Pass the next value to 'produce()' or call 'finish()'. If
+    // neither is called, return the time to wait before being called
+    // again.
+    virtual int generate() = 0;
+
+    // Pass 'value' to the consumer.
+    void produce(const T& value)
+    {
+      this->value = value;
+      full = true;
+      awakeConsumer();
+    }
+
+    // Tell the consumer that there are no more values.
+    void finish()
+    {
+      finished = true;
+      awakeConsumer();
+    }
+
+  public:
+    // Create a generator. It is suspended until a value is wanted.
+    // See 'CoRoutine' for the meaning of 'waitRelativeToWorkerExit'.
+    Generator(bool waitRelativeToWorkerExit = false)
+      : CoRoutine(waitRelativeToWorkerExit),
+        value(),
+        full(false),
+        finished(false),
+        consumer(0)
+    {
+      suspend();
+    }
+
+    // Returns 'true' and the next value in 'value' if it is available.
+    // Otherwise 'coRoutine' waits for it: it is awakened when the value
+    // has been produced (or the generator has finished), and its worker
+    // should return -1 (or a timeout) now.
+    bool next(CoRoutine& coRoutine, T& value)
+    {
+      const bool available = full;
+      if (available)
+      {
+        value = this->value;
+        full = false;
+      }
+      else if (!finished)
+      {
+        consumer = &coRoutine;
+      }
+      
+      // Produce the next value (or the one waited for.)
+      if (!finished)
+      {
+        resumeNow();
+      }
+      return available;
+    }
+
+    // Returns 'true' iff all values have been consumed.
+    bool isFinished()
+    {
+      return finished && !full;
+    }
+
+    // Start producing values again after the generator has finished.
+    void restart()
+    {
+      finished = false;
+    }
+  };
+
+} // end of namespace coroutines
+
+#endif // __coroutines_generator_h__
@@ -0,0 +1,251 @@
+/*
+  Simple co-routine library for Arduino.
+  
+  Copyright 2011-2017 Martin Gamwell Dawids.
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+  For an overview of the functionality in this file,
+  please see the file "OffloadPool.h".
+*/
+
+#include <OffloadPool.h>
+
+#if defined(CoRoutinesHost) && defined(__linux__)
+
+#include <ConcurrentScheduler.h>
+#include <EventLoop.h>
+#include <stdint.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+namespace coroutines {
+
+  OffloadPool::OffloadPool(unsigned char noThreads, size_t maxJobs, unsigned int pollInterval)
+    : jobs(0),
+      maxJobs(maxJobs == 0 ? 1 : maxJobs),
+      noJobs(0),
+      threads(0),
+      noThreads(noThreads == 0 ? 1 : noThreads),
+      stopping(false),
+      completed(0),
+      loop(0),
+      concurrentScheduler(0),
+      eventFd(-1),
+      pollInterval(pollInterval)
+  {
+    start();
+  }
+
+  OffloadPool::OffloadPool(EventLoop& loop, unsigned char noThreads, size_t maxJobs)
+    : jobs(0),
+      maxJobs(maxJobs == 0 ? 1 : maxJobs),
+      noJobs(0),
+      threads(0),
+      noThreads(noThreads == 0 ? 1 : noThreads),
+      stopping(false),
+      completed(0),
+      loop(&loop),
+      concurrentScheduler(0),
+      eventFd(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)),
+      pollInterval(1)
+  {
+    start();
+  }
+
+  OffloadPool::OffloadPool(ConcurrentScheduler& scheduler, unsigned char noThreads, size_t maxJobs)
+    : jobs(0),
+      maxJobs(maxJobs == 0 ? 1 : maxJobs),
+      noJobs(0),
+      threads(0),
+      noThreads(noThreads == 0 ? 1 : noThreads),
+      stopping(false),
+      completed(0),
+      loop(0),
+      concurrentScheduler(&scheduler),
+      eventFd(-1),
+      pollInterval(1)
+  {
+    start();
+  }
+
+  void OffloadPool::start()
+  {
+    jobs = new Job[maxJobs];
+    for (size_t i = 0; i != maxJobs; ++i)
+    {
+      jobs[i].state.store(jobFree, std::memory_order_relaxed);
+    }
+    sem_init(&waiting, 0, 0);
+    
+    threads = new std::thread[noThreads];
+    for (unsigned char i = 0; i != noThreads; ++i)
+    {
+      threads[i] = std::thread(&OffloadPool::runThread, this);
+    }
+  }
+
+  OffloadPool::~OffloadPool()
+  {
+    // Each thread takes one post and sees that the pool is stopping.
+    stopping.store(true, std::memory_order_relaxed);
+    for (unsigned char i = 0; i != noThreads; ++i)
+    {
+      sem_post(&waiting);
+    }
+    for (unsigned char i = 0; i != noThreads; ++i)
+    {
+      threads[i].join();
+    }
+    delete[] threads;
+    sem_destroy(&waiting);
+    delete[] jobs;
+    if (eventFd >= 0)
+    {
+      loop->cancelWait(eventFd);
+      close(eventFd);
+    }
+  }
+
+  void OffloadPool::runThread()
+  {
+    for (;;)
+    {
+      if (sem_wait(&waiting) != 0)
+      {
+        // Interrupted by a signal.
+        continue;
+      }
+      if (stopping.load(std::memory_order_relaxed))
+      {
+        return;
+      }
+
+      // Each post is preceded by a job becoming waiting, so there is a
+      // waiting job for each thread getting past the semaphore.
+      for (size_t i = 0; ; i = (i + 1) % maxJobs)
+      {
+        Job& job = jobs[i];
+        unsigned char state = jobWaiting;
+        if (job.state.compare_exchange_strong(state, jobRunning, std::memory_order_acquire))
+        {
+          job.function(job.argument);
+          complete(job);
+          break;
+        }
+      }
+    }
+  }
+
+  void OffloadPool::complete(Job& job)
+  {
+    Job* head = completed.load(std::memory_order_relaxed);
+    do
+    {
+      job.nextCompleted = head;
+    }
+    while (!completed.compare_exchange_weak(head, &job, std::memory_order_release,
+                                            std::memory_order_relaxed));
+
+    if (eventFd >= 0)
+    {
+      const uint64_t one = 1;
+      const ssize_t n = write(eventFd, &one, sizeof(one));
+      (void) n;
+    }
+    else if (concurrentScheduler != 0)
+    {
+      // The command queue may be full for a moment.
+      while (!concurrentScheduler->awakeConcurrently(*this) &&
+             !stopping.load(std::memory_order_relaxed))
+      {
+        std::this_thread::yield();
+      }
+    }
+  }
+
+  int OffloadPool::worker()
+  {
+    if (eventFd >= 0)
+    {
+      // Reset the counter before taking the list: a function completing
+      // after that writes the counter again.
+      uint64_t count;
+      const ssize_t n = read(eventFd, &count, sizeof(count));
+      (void) n;
+    }
+
+    // Take all completed jobs and awake their co-routines in the order
+    // the functions returned.
+    Job* list = completed.exchange(0, std::memory_order_acquire);
+    Job* reversed = 0;
+    while (list != 0)
+    {
+      Job* const next = list->nextCompleted;
+      list->nextCompleted = reversed;
+      reversed = list;
+      list = next;
+    }
+    for (Job* job = reversed; job != 0; job = job->nextCompleted)
+    {
+      job->state.store(jobFree, std::memory_order_relaxed);
+      --noJobs;
+
+      job->coRoutine->resumeNow();
+    }
+
+    if (noJobs == 0 || concurrentScheduler != 0)
+    {
+      // Sleep until something is offloaded or completes.
+      return -1;
+    }
+    if (eventFd >= 0 && loop->waitReadable(eventFd, *this))
+    {
+      return -1;
+    }
+    return (int) pollInterval;
+  }
+
+  bool OffloadPool::offload(CoRoutine& coRoutine, OffloadFunction function, void* argument)
+  {
+    if (noJobs == maxJobs)
+    {
+      return false;
+    }
+
+    size_t index = 0;
+    while (jobs[index].state.load(std::memory_order_relaxed) != jobFree)
+    {
+      ++index;
+    }
+    Job& job = jobs[index];
+    job.coRoutine = &coRoutine;
+    job.function = function;
+    job.argument = argument;
+    job.state.store(jobWaiting, std::memory_order_release);
+    ++noJobs;
+    sem_post(&waiting);
+
+    // Start waiting for the function to return.
+    resumeNow();
+    return true;
+  }
+
+  size_t OffloadPool::getJobCount()
+  {
+    return noJobs;
+  }
+
+} // end of namespace coroutines
+
+#endif // CoRoutinesHost && __linux__
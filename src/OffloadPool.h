@@ -0,0 +1,177 @@
+/*
+  Simple co-routine library for Arduino.
+  
+  Copyright 2011-2017 Martin Gamwell Dawids.
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+  OffloadPool (Linux host builds only)
+  ------------------------------------
+  A worker must never block: while it does, no other co-routine of the
+  scheduler runs. An offload pool runs blocking functions (file writes,
+  compression, ...) on a fixed number of background threads instead.
+
+  A co-routine offloads a function by calling OffloadPool::offload() and
+  returning -1 from its worker. When the function has returned, the
+  co-routine is awakened by the pool, which is itself a co-routine of the
+  scheduler:
+
+    OffloadPool pool(2, 8); // 2 threads, up to 8 functions at a time.
+    scheduler.addCoRoutine(pool);
+    ...
+    static void compress(void* argument)
+    {
+      ...
+    }
+    ...
+    int worker()
+    {
+      if (!compressing)
+      {
+        if (!pool.offload(*this, compress, &buffer))
+        {
+          // The pool is busy. Try again later.
+          return 10;
+        }
+        compressing = true;
+        return -1;
+      }
+      compressing = false;
+      ...
+    }
+
+  The offloaded function runs on another thread, so it must not touch
+  anything the co-routines use until it has returned. The dispatch thread
+  never blocks on the pool: functions are handed to the threads through a
+  POSIX semaphore, and the threads push the functions that have returned
+  on a lock-free completion list.
+
+  How the pool learns of completed functions depends on its constructor:
+
+    OffloadPool pool(loop, 2, 8);      // An EventLoop: an 'eventfd'
+                                       // written by the threads wakes it.
+    OffloadPool pool(scheduler, 2, 8); // A ConcurrentScheduler: the
+                                       // threads awake it concurrently.
+    OffloadPool pool(2, 8);            // Any other scheduler: it polls
+                                       // every 'pollInterval' milliseconds
+                                       // while functions are running.
+
+  With an event loop or a concurrent scheduler the pool costs nothing
+  while it waits. The pool must be added to the scheduler of the loop or
+  to the concurrent scheduler. A completed function is noticed right away
+  as long as the dispatch thread sleeps in an EventLoop or in
+  ConcurrentScheduler::waitForWakeup(), which wake up when the pool awakes
+  itself concurrently. A dispatch thread sleeping in any other way notices
+  it when it wakes up.
+
+  A co-routine must not be destroyed while a function offloaded for it
+  runs. Destroying the pool waits for the functions running; functions
+  not yet started are dropped.
+ */
+
+#ifndef __coroutines_offloadpool_h__
+#define __coroutines_offloadpool_h__
+
+#include <CoRoutines.h>
+
+#if defined(CoRoutinesHost) && defined(__linux__)
+
+#include <atomic>
+#include <semaphore.h>
+#include <thread>
+
+namespace coroutines {
+
+  class EventLoop;
+  class ConcurrentScheduler;
+
+  // A function to run on a thread of an offload pool.
+  typedef void (*OffloadFunction)(void* argument);
+
+  // A co-routine running blocking functions on background threads.
+  class OffloadPool : public CoRoutine
+  {
+  private:
+    enum JobState
+    {
+      jobFree,
+      jobWaiting,
+      jobRunning
+    };
+
+    // A function offloaded.
+    struct Job
+    {
+      CoRoutine* coRoutine;
+      OffloadFunction function;
+      void* argument;
+      std::atomic<unsigned char> state;
+      Job* nextCompleted;
+    };
+
+    Job* jobs;
+    const size_t maxJobs;
+    size_t noJobs;                  // Jobs not free.
+    sem_t waiting;                  // Counts jobs waiting for a thread.
+    std::thread* threads;
+    const unsigned char noThreads;
+    std::atomic<bool> stopping;
+    std::atomic<Job*> completed;    // Most recently completed first.
+    EventLoop* const loop;
+    ConcurrentScheduler* const concurrentScheduler;
+    int eventFd;                    // Written on completion (-1 if none.)
+    const unsigned int pollInterval;
+
+    // Create the threads.
+    void start();
+
+    // The loop of a thread of the pool.
+    void runThread();
+
+    // Tell the dispatch thread that 'job' has completed.
+    void complete(Job& job);
+
+  protected:
+    // Awake the co-routines whose functions have returned.
+    virtual int worker();
+
+  public:
+    // Create 'noThreads' threads (at least 1) running up to 'maxJobs'
+    // functions (at least 1) at a time. While functions are running, the
+    // pool checks for completed ones every 'pollInterval' milliseconds.
+    OffloadPool(unsigned char noThreads, size_t maxJobs, unsigned int pollInterval = 1);
+
+    // Create a pool woken by 'loop' when functions complete.
+    OffloadPool(EventLoop& loop, unsigned char noThreads, size_t maxJobs);
+
+    // Create a pool awakened through 'scheduler' when functions complete.
+    OffloadPool(ConcurrentScheduler& scheduler, unsigned char noThreads, size_t maxJobs);
+
+    // Waits for the functions running.
+    virtual ~OffloadPool();
+
+    // Run 'function(argument)' on a thread of the pool and awake
+    // 'coRoutine' when it has returned. Returns 'false' if 'maxJobs'
+    // functions are running or waiting to run already.
+    // Must be called by the thread running the scheduler of the pool.
+    bool offload(CoRoutine& coRoutine, OffloadFunction function, void* argument = 0);
+
+    // Returns the number of functions running or waiting to run.
+    size_t getJobCount();
+  };
+
+} // end of namespace coroutines
+
+#endif // CoRoutinesHost && __linux__
+
+#endif // __coroutines_offloadpool_h__
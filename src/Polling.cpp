@@ -0,0 +1,240 @@
+/*
+  Simple co-routine library for Arduino.
+  
+  Copyright 2011-2017 Martin Gamwell Dawids.
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+  For an overview of the functionality in this file,
+  please see the file "Polling.h".
+*/
+
+#include <Polling.h>
+
+namespace coroutines {
+
+  // The largest wait time a worker can return.
+  static const unsigned int maxWaitTime = ((unsigned int) -1) >> 1;
+
+  PollingCoRoutine::PollingCoRoutine(unsigned int timeout)
+    : CoRoutine(catchUpRelativeToExit),
+      timeout(timeout),
+      requested(false),
+      requestTime(0),
+      pollInterval(0),
+      polls(0),
+      lastPolls(0),
+      lastTimeToReady(0),
+      totalPolls(0),
+      readyCount(0),
+      timeoutCount(0)
+  { }
+
+  int PollingCoRoutine::timedOut()
+  {
+    return 0;
+  }
+
+  void PollingCoRoutine::readyAfter(unsigned long)
+  { }
+
+  int PollingCoRoutine::worker()
+  {
+    const unsigned long now = currentTime();
+    if (!requested)
+    {
+      request();
+      requested = true;
+      requestTime = now;
+      polls = 0;
+      pollInterval = getFirstPollInterval();
+    }
+    else
+    {
+      ++polls;
+      ++totalPolls;
+      
+      const unsigned long elapsed = now - requestTime;
+      if (isReady())
+      {
+        requested = false;
+        lastTimeToReady = elapsed;
+        lastPolls = polls;
+        ++readyCount;
+        readyAfter(elapsed);
+        return ready();
+      }
+      if (timeout != 0 && elapsed >= timeout)
+      {
+        requested = false;
+        ++timeoutCount;
+        return timedOut();
+      }
+      pollInterval = getNextPollInterval(pollInterval);
+    }
+    
+    // Do not wait past the timeout.
+    unsigned int wait = (pollInterval > maxWaitTime ? maxWaitTime : pollInterval);
+    if (timeout != 0)
+    {
+      const unsigned long left = timeout - (now - requestTime);
+      if (wait > left)
+      {
+        wait = left;
+      }
+    }
+    return wait;
+  }
+
+  unsigned long PollingCoRoutine::getLastTimeToReady()
+  {
+    return lastTimeToReady;
+  }
+
+  unsigned int PollingCoRoutine::getLastPollCount()
+  {
+    return lastPolls;
+  }
+
+  unsigned long PollingCoRoutine::getPollCount()
+  {
+    return totalPolls;
+  }
+
+  unsigned long PollingCoRoutine::getReadyCount()
+  {
+    return readyCount;
+  }
+
+  unsigned long PollingCoRoutine::getTimeoutCount()
+  {
+    return timeoutCount;
+  }
+
+  BackoffPoller::BackoffPoller(unsigned int initialInterval, unsigned int multiplierPercent,
+                               unsigned int maxInterval, unsigned int timeout)
+    : PollingCoRoutine(timeout),
+      initialInterval(initialInterval),
+      multiplierPercent(multiplierPercent),
+      maxInterval(maxInterval)
+  { }
+
+  unsigned int BackoffPoller::getFirstPollInterval()
+  {
+    return initialInterval;
+  }
+
+  unsigned int BackoffPoller::getNextPollInterval(unsigned int previousInterval)
+  {
+    const unsigned long interval = (unsigned long) previousInterval * multiplierPercent / 100;
+    return (unsigned int) (interval > maxInterval ? maxInterval : (interval == 0 ? 1 : interval));
+  }
+
+  AdaptivePoller::AdaptivePoller(unsigned int initialGuess, unsigned int tightInterval,
+                                 unsigned int timeout)
+    : PollingCoRoutine(timeout),
+      initialGuess(initialGuess),
+      tightInterval(tightInterval)
+  {
+    resetModel();
+  }
+
+  unsigned int AdaptivePoller::getFirstPollInterval()
+  {
+    if (samples == 0)
+    {
+      return initialGuess;
+    }
+    
+    // Poll a little before the device is expected to be ready, but not
+    // before it has ever been seen ready.
+    const unsigned long mean = getMeanTimeToReady();
+    const unsigned long margin = 2 * getDeviation() + tightInterval / 2;
+    unsigned long interval = (mean > margin ? mean - margin : 0);
+    if (interval < minTime && minTime > tightInterval)
+    {
+      interval = minTime - tightInterval;
+    }
+    return (unsigned int) (interval > maxWaitTime ? maxWaitTime : interval);
+  }
+
+  unsigned int AdaptivePoller::getNextPollInterval(unsigned int)
+  {
+    return tightInterval;
+  }
+
+  void AdaptivePoller::readyAfter(unsigned long timeToReady)
+  {
+    if (samples == 0)
+    {
+      smoothedTime = timeToReady * 8;
+      smoothedDeviation = timeToReady * 2;
+      minTime = timeToReady;
+      maxTime = timeToReady;
+    }
+    else
+    {
+      // smoothed += (sample - smoothed) / 8
+      // deviation += (|sample - smoothed| - deviation) / 4
+      const long error = (long) timeToReady - (long) (smoothedTime / 8);
+      smoothedTime = smoothedTime - smoothedTime / 8 + timeToReady;
+      const unsigned long absError = (unsigned long) (error < 0 ? -error : error);
+      smoothedDeviation = smoothedDeviation - smoothedDeviation / 4 + absError;
+      
+      if (timeToReady < minTime)
+      {
+        minTime = timeToReady;
+      }
+      if (timeToReady > maxTime)
+      {
+        maxTime = timeToReady;
+      }
+    }
+    ++samples;
+  }
+
+  unsigned long AdaptivePoller::getSampleCount()
+  {
+    return samples;
+  }
+
+  unsigned long AdaptivePoller::getMeanTimeToReady()
+  {
+    return smoothedTime / 8;
+  }
+
+  unsigned long AdaptivePoller::getDeviation()
+  {
+    return smoothedDeviation / 4;
+  }
+
+  unsigned long AdaptivePoller::getMinTimeToReady()
+  {
+    return minTime;
+  }
+
+  unsigned long AdaptivePoller::getMaxTimeToReady()
+  {
+    return maxTime;
+  }
+
+  void AdaptivePoller::resetModel()
+  {
+    samples = 0;
+    smoothedTime = 0;
+    smoothedDeviation = 0;
+    minTime = 0;
+    maxTime = 0;
+  }
+
+} // end of namespace coroutines
@@ -0,0 +1,195 @@
+/*
+  Simple co-routine library for Arduino.
+  
+  Copyright 2011-2017 Martin Gamwell Dawids.
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+  Polling
+  -------
+  A common use of co-routines is to start an operation on a device (e.g. a
+  measurement) and then poll the device until the result is ready.
+  PollingCoRoutine implements this pattern. Instead of 'worker()' override
+
+    request()   to start the operation,
+    isReady()   to poll the device, and
+    ready()     to fetch the result. Like 'worker()' it returns the number
+                of milliseconds until the next operation should be started
+                (or -1 to suspend.)
+
+  and optionally 'timedOut()' to handle a device that does not become
+  ready within the timeout.
+
+  How often the device is polled is decided by a subclass. BackoffPoller
+  polls first after an initial interval and then multiplies the interval
+  by a factor for each poll, up to a maximum interval. This keeps the
+  number of polls low without adding much latency when the time to
+  readiness varies a lot.
+
+  AdaptivePoller learns how long the device takes to become ready. It
+  keeps a smoothed mean and mean deviation of the time to readiness (like
+  TCP estimates round-trip times), polls first just before the device is
+  expected to be ready and then polls at a short interval. This minimises
+  both the latency and the number of polls when the time to readiness is
+  fairly stable, e.g. for a sensor conversion. The learned model can be
+  inspected, see AdaptivePoller::getMeanTimeToReady().
+
+  The poller keeps track of the time from the request to the device being
+  found ready, see PollingCoRoutine::getLastTimeToReady(), and of the
+  number of polls needed.
+ */
+
+#ifndef __coroutines_polling_h__
+#define __coroutines_polling_h__
+
+#include <CoRoutines.h>
+
+namespace coroutines {
+
+  // A co-routine starting an operation and polling until it is ready.
+  class PollingCoRoutine : public CoRoutine
+  {
+  private:
+    const unsigned int timeout;
+    bool requested;
+    unsigned long requestTime;
+    unsigned int pollInterval;    // Last interval used.
+    unsigned int polls;           // Polls of the current operation.
+    unsigned int lastPolls;
+    unsigned long lastTimeToReady;
+    unsigned long totalPolls;
+    unsigned long readyCount;
+    unsigned long timeoutCount;
+    
+  protected:
+    // Start the operation.
+    virtual void request() = 0;
+
+    // Returns 'true' if the operation has completed.
+    virtual bool isReady() = 0;
+
+    // Called when the operation has completed. Returns the number of
+    // milliseconds until the next operation should be requested, or -1 to
+    // suspend the co-routine.
+    virtual int ready() = 0;
+
+    // Called when the operation has not completed within the timeout.
+    // Returns like 'ready()'. The default implementation retries at once.
+    virtual int timedOut();
+
+    // Returns the milliseconds from the request to the first poll.
+    virtual unsigned int getFirstPollInterval() = 0;
+
+    // Returns the milliseconds until the next poll when the last poll
+    // was 'previousInterval' milliseconds after the one before it.
+    virtual unsigned int getNextPollInterval(unsigned int previousInterval) = 0;
+
+    // Called with the time from the request until the operation was found
+    // ready. The default implementation does nothing.
+    virtual void readyAfter(unsigned long timeToReady);
+
+    // Requests and polls.
+    virtual int worker();
+    
+  public:
+    // Create a poller giving up after 'timeout' milliseconds (0 for never.)
+    PollingCoRoutine(unsigned int timeout = 0);
+
+    // Returns the milliseconds from the last request until the operation
+    // was found ready.
+    unsigned long getLastTimeToReady();
+
+    // Returns the number of polls of the last operation that became ready.
+    unsigned int getLastPollCount();
+
+    // Returns the number of polls in total.
+    unsigned long getPollCount();
+
+    // Returns the number of operations that became ready.
+    unsigned long getReadyCount();
+
+    // Returns the number of operations that timed out.
+    unsigned long getTimeoutCount();
+  };
+
+
+  // A poller polling with exponential backoff.
+  class BackoffPoller : public PollingCoRoutine
+  {
+  private:
+    const unsigned int initialInterval;
+    const unsigned int multiplierPercent;
+    const unsigned int maxInterval;
+    
+  protected:
+    virtual unsigned int getFirstPollInterval();
+    virtual unsigned int getNextPollInterval(unsigned int previousInterval);
+    
+  public:
+    // Create a poller polling first after 'initialInterval' milliseconds
+    // and then multiplying the interval by 'multiplierPercent' / 100 per
+    // poll until it reaches 'maxInterval'. Gives up after 'timeout'
+    // milliseconds (0 for never.)
+    BackoffPoller(unsigned int initialInterval, unsigned int multiplierPercent,
+                  unsigned int maxInterval, unsigned int timeout = 0);
+  };
+
+
+
+  // A poller learning when the operation is expected to be ready.
+  class AdaptivePoller : public PollingCoRoutine
+  {
+  private:
+    const unsigned int initialGuess;
+    const unsigned int tightInterval;
+    unsigned long samples;
+    unsigned long smoothedTime;   // Mean time to readiness times 8.
+    unsigned long smoothedDeviation; // Mean deviation times 4.
+    unsigned long minTime;
+    unsigned long maxTime;
+    
+  protected:
+    virtual unsigned int getFirstPollInterval();
+    virtual unsigned int getNextPollInterval(unsigned int previousInterval);
+    virtual void readyAfter(unsigned long timeToReady);
+    
+  public:
+    // Create a poller polling first after 'initialGuess' milliseconds
+    // until it has learned the time to readiness, and then polling every
+    // 'tightInterval' milliseconds after the first poll. Gives up after
+    // 'timeout' milliseconds (0 for never.)
+    AdaptivePoller(unsigned int initialGuess, unsigned int tightInterval,
+                   unsigned int timeout = 0);
+
+    // Returns the number of times to readiness learned from.
+    unsigned long getSampleCount();
+
+    // Returns the smoothed mean time to readiness in milliseconds.
+    unsigned long getMeanTimeToReady();
+
+    // Returns the smoothed mean deviation of the time to readiness.
+    unsigned long getDeviation();
+
+    // Returns the shortest time to readiness observed.
+    unsigned long getMinTimeToReady();
+
+    // Returns the longest time to readiness observed.
+    unsigned long getMaxTimeToReady();
+
+    // Forget what has been learned.
+    void resetModel();
+  };
+
+} // end of namespace coroutines
+
+#endif // __coroutines_polling_h__
@@ -0,0 +1,84 @@
+/*
+  Simple co-routine library for Arduino.
+  
+  Copyright 2011-2017 Martin Gamwell Dawids.
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+  For an overview of the functionality in this file,
+  please see the file "RateLimiter.h".
+*/
+
+#include <RateLimiter.h>
+
+namespace coroutines {
+
+  const unsigned long RateLimiter::never;
+
+  RateLimiter::RateLimiter(unsigned int rate, unsigned int period, unsigned int burst)
+    : rate(rate == 0 ? 1 : rate),
+      period(period == 0 ? 1 : period),
+      capacity((long) burst * (period == 0 ? 1 : period)),
+      level(capacity),
+      lastRefill(currentTime())
+  { }
+
+  void RateLimiter::refill()
+  {
+    const unsigned long now = currentTime();
+    const unsigned long elapsed = now - lastRefill;
+    lastRefill = now;
+    
+    // Avoid overflow when the limiter has not been used for a long time.
+    const unsigned long untilFull = (unsigned long) (capacity - level + rate - 1) / rate;
+    if (elapsed >= untilFull)
+    {
+      level = capacity;
+    }
+    else
+    {
+      level += elapsed * rate;
+    }
+  }
+
+  unsigned long RateLimiter::tryAcquire(unsigned int tokens)
+  {
+    refill();
+    const long cost = (long) tokens * period;
+    if (level >= cost)
+    {
+      level -= cost;
+      return 0;
+    }
+    if (cost > capacity)
+    {
+      // The bucket never holds that many tokens.
+      return never;
+    }
+    return (unsigned long) (cost - level + rate - 1) / rate;
+  }
+
+  unsigned long RateLimiter::reserve(unsigned int tokens)
+  {
+    refill();
+    level -= (long) tokens * period;
+    return (level >= 0 ? 0 : (unsigned long) (-level + rate - 1) / rate);
+  }
+
+  unsigned int RateLimiter::getAvailableTokens()
+  {
+    refill();
+    return (level <= 0 ? 0 : (unsigned int) (level / period));
+  }
+
+} // end of namespace coroutines
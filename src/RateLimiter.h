@@ -0,0 +1,105 @@
+/*
+  Simple co-routine library for Arduino.
+  
+  Copyright 2011-2017 Martin Gamwell Dawids.
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+  RateLimiter
+  -----------
+  A RateLimiter is a token bucket shared by co-routines using a
+  rate-limited resource, e.g. radio airtime. Tokens are added at a fixed
+  rate up to a maximum (the burst). Using the resource costs one or more
+  tokens.
+
+  A co-routine that cannot get its tokens should not poll the limiter.
+  RateLimiter::tryAcquire() returns the exact number of milliseconds until
+  the tokens will be available, which the co-routine waits for. The wait
+  does not always fit the 'int' returned by a worker (e.g. a minute with
+  RateLimiter(1, 60000, 1) on AVR), so derive the co-routine from
+  LongWaitCoRoutine and return the wait with Next::after():
+
+    RateLimiter limiter(10, 1000, 5); // 10 tokens per second, burst of 5.
+
+    Next work()
+    {
+      const unsigned long wait = limiter.tryAcquire();
+      if (wait == RateLimiter::never)
+      {
+        return Next::suspend();
+      }
+      if (wait != 0)
+      {
+        return Next::after(wait);
+      }
+      send();
+      ...
+    }
+
+  Asking for more tokens than the burst can never succeed.
+  RateLimiter::tryAcquire() then returns RateLimiter::never, which must not
+  be waited for.
+
+  When several co-routines wait for the same limiter they would all wake
+  up at the same time and all but one would have to wait again.
+  RateLimiter::reserve() avoids that by taking the tokens right away (the
+  bucket goes into debt) and returning when they may be used. The
+  co-routine remembers it has a reservation and uses the resource when it
+  is invoked after the wait without asking the limiter again.
+ */
+
+#ifndef __coroutines_ratelimiter_h__
+#define __coroutines_ratelimiter_h__
+
+#include <CoRoutines.h>
+
+namespace coroutines {
+
+  // A token bucket.
+  class RateLimiter
+  {
+  private:
+    // The bucket is kept in units of 1 / 'period' tokens so refilling
+    // adds 'rate' units per millisecond.
+    const unsigned long rate;
+    const unsigned long period;
+    const long capacity;
+    long level;               // Negative when tokens have been reserved.
+    unsigned long lastRefill;
+    
+    void refill();
+    
+  public:
+    // Returned by 'tryAcquire()' for more tokens than the burst.
+    static const unsigned long never = (unsigned long) -1;
+
+    // Create a limiter adding 'rate' tokens every 'period' milliseconds
+    // holding at most 'burst' tokens. The limiter starts out full.
+    RateLimiter(unsigned int rate, unsigned int period, unsigned int burst);
+
+    // Take 'tokens' tokens if available and return 0. Otherwise, take
+    // nothing and return the number of milliseconds until they will be,
+    // or 'never' if 'tokens' exceeds the burst.
+    unsigned long tryAcquire(unsigned int tokens = 1);
+
+    // Take 'tokens' tokens even if not available. Returns the number of
+    // milliseconds until they may be used.
+    unsigned long reserve(unsigned int tokens = 1);
+
+    // Returns the number of whole tokens available now.
+    unsigned int getAvailableTokens();
+  };
+
+} // end of namespace coroutines
+
+#endif // __coroutines_ratelimiter_h__
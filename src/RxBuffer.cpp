@@ -0,0 +1,163 @@
+/*
+  Simple co-routine library for Arduino.
+  
+  Copyright 2011-2017 Martin Gamwell Dawids.
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+  For an overview of the functionality in this file,
+  please see the file "RxBuffer.h".
+*/
+
+#include <RxBuffer.h>
+
+namespace coroutines {
+
+  RxBuffer::RxBuffer(unsigned char* buffer, size_t size)
+    : buffer(buffer),
+      size(size),
+      head(0),
+      count(0),
+      overflows(0),
+      waiter(0),
+      wantedBytes(0),
+      delimiter(0),
+      delimiterReceived(false),
+      waitStart(0),
+      timeout(0)
+  { }
+
+  bool RxBuffer::isSatisfied()
+  {
+    return (wantedBytes == 0 ? delimiterReceived : count >= wantedBytes);
+  }
+
+  bool RxBuffer::put(unsigned char byte)
+  {
+    if (count == size)
+    {
+      ++overflows;
+      return false;
+    }
+    buffer[(head + count) % size] = byte;
+    ++count;
+
+    if (waiter != 0)
+    {
+      if (wantedBytes == 0 && byte == delimiter)
+      {
+        delimiterReceived = true;
+      }
+      if (isSatisfied())
+      {
+        waiter->resumeNow();
+      }
+    }
+    return true;
+  }
+
+  size_t RxBuffer::put(const unsigned char* data, size_t length)
+  {
+    size_t added = 0;
+    while (added != length && put(data[added]))
+    {
+      ++added;
+    }
+    return added;
+  }
+
+  size_t RxBuffer::available()
+  {
+    return count;
+  }
+
+  int RxBuffer::peek()
+  {
+    return (count == 0 ? -1 : buffer[head]);
+  }
+
+  int RxBuffer::read()
+  {
+    if (count == 0)
+    {
+      return -1;
+    }
+    const unsigned char byte = buffer[head];
+    head = (head + 1) % size;
+    --count;
+    return byte;
+  }
+
+  size_t RxBuffer::getOverflowCount()
+  {
+    return overflows;
+  }
+
+  RxBuffer::WaitResult RxBuffer::wait(CoRoutine& coRoutine, unsigned int timeout)
+  {
+    const unsigned long now = currentTime();
+    if (waiter != &coRoutine)
+    {
+      // First call. Start waiting.
+      waiter = &coRoutine;
+      waitStart = now;
+      this->timeout = timeout;
+    }
+    
+    if (isSatisfied())
+    {
+      waiter = 0;
+      return waitReady;
+    }
+    if (now - waitStart >= this->timeout)
+    {
+      waiter = 0;
+      return waitTimedOut;
+    }
+    return waitPending;
+  }
+
+  RxBuffer::WaitResult RxBuffer::waitFor(CoRoutine& coRoutine, size_t noBytes, unsigned int timeout)
+  {
+    wantedBytes = (noBytes == 0 ? 1 : noBytes);
+    return wait(coRoutine, timeout);
+  }
+
+  RxBuffer::WaitResult RxBuffer::waitForDelimiter(CoRoutine& coRoutine, unsigned char delimiter, unsigned int timeout)
+  {
+    if (waiter != &coRoutine || wantedBytes != 0 || this->delimiter != delimiter)
+    {
+      // Look for the delimiter among the bytes received already.
+      wantedBytes = 0;
+      this->delimiter = delimiter;
+      delimiterReceived = false;
+      for (size_t i = 0; i != count && !delimiterReceived; ++i)
+      {
+        delimiterReceived = (buffer[(head + i) % size] == delimiter);
+      }
+    }
+    return wait(coRoutine, timeout);
+  }
+
+  int RxBuffer::getTimeLeft()
+  {
+    const unsigned long waited = currentTime() - waitStart;
+    return (int) (waited >= timeout ? 0 : timeout - waited);
+  }
+
+  void RxBuffer::cancelWait()
+  {
+    waiter = 0;
+  }
+
+} // end of namespace coroutines
@@ -0,0 +1,155 @@
+/*
+  Simple co-routine library for Arduino.
+  
+  Copyright 2011-2017 Martin Gamwell Dawids.
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+  RxBuffer
+  --------
+  An RxBuffer is a receive buffer a co-routine can wait on until a number
+  of bytes or a delimiter has been received, with a timeout. This avoids
+  polling e.g. 'Serial.available()' from a worker every few milliseconds.
+
+  The buffer is filled from outside the co-routine, e.g. from
+  'serialEvent()' on Arduino or from the bytes read from a pipe or pty on
+  a host:
+
+    unsigned char rxData[64];
+    RxBuffer rx(rxData, sizeof(rxData));
+
+    void serialEvent()
+    {
+      rx.fill(Serial);
+    }
+
+  The co-routine waiting is made due as soon as what it waits for has
+  been received:
+
+    int worker()
+    {
+      switch (rx.waitForDelimiter(*this, '\n', 1000))
+      {
+        case RxBuffer::waitReady:
+          // A line has been received. Read it with 'rx.read()'.
+          ...
+          return 0;
+        case RxBuffer::waitTimedOut:
+          ...
+          return 0;
+        default:
+          return rx.getTimeLeft();
+      }
+    }
+
+  Only one co-routine can wait on a buffer at a time. The buffer is not
+  safe to fill from an interrupt handler.
+ */
+
+#ifndef __coroutines_rxbuffer_h__
+#define __coroutines_rxbuffer_h__
+
+#include <CoRoutines.h>
+
+namespace coroutines {
+
+  // A receive buffer a co-routine can wait on.
+  class RxBuffer
+  {
+  public:
+    enum WaitResult
+    {
+      waitReady,      // What was waited for has been received.
+      waitPending,    // Still waiting. Return 'getTimeLeft()' from the worker.
+      waitTimedOut    // The timeout expired. The wait has ended.
+    };
+    
+  private:
+    unsigned char* const buffer;
+    const size_t size;
+    size_t head;              // Index of the oldest byte.
+    size_t count;             // Number of bytes in the buffer.
+    size_t overflows;         // Bytes dropped because the buffer was full.
+
+    // The co-routine waiting, if any, and what it is waiting for.
+    CoRoutine* waiter;
+    size_t wantedBytes;       // 0 when waiting for the delimiter.
+    unsigned char delimiter;
+    bool delimiterReceived;
+    unsigned long waitStart;
+    unsigned int timeout;
+
+    bool isSatisfied();
+    WaitResult wait(CoRoutine& coRoutine, unsigned int timeout);
+    
+  public:
+    // Create a receive buffer using the 'size' bytes of 'buffer'.
+    RxBuffer(unsigned char* buffer, size_t size);
+
+    // Add 'byte' to the buffer. Returns 'false' if the buffer is full.
+    // Awakes the waiting co-routine if it is now ready.
+    bool put(unsigned char byte);
+
+    // Add the 'length' bytes of 'data'. Returns the number added.
+    size_t put(const unsigned char* data, size_t length);
+
+    // Move available bytes from 'stream' (anything having 'available()'
+    // and 'read()' like 'Serial') into the buffer while there is room.
+    // Returns the number of bytes moved.
+    template <class S> size_t fill(S& stream)
+    {
+      size_t moved = 0;
+      while (count != size && stream.available() > 0)
+      {
+        const int c = stream.read();
+        if (c < 0)
+        {
+          break;
+        }
+        put((unsigned char) c);
+        ++moved;
+      }
+      return moved;
+    }
+
+    // Returns the number of bytes in the buffer.
+    size_t available();
+
+    // Returns the next byte without removing it, or -1 if empty.
+    int peek();
+
+    // Removes and returns the next byte, or -1 if empty.
+    int read();
+
+    // Returns the number of bytes dropped because the buffer was full.
+    size_t getOverflowCount();
+
+    // Wait until at least 'noBytes' bytes are in the buffer, but at most
+    // 'timeout' milliseconds from the first call.
+    WaitResult waitFor(CoRoutine& coRoutine, size_t noBytes, unsigned int timeout);
+
+    // Wait until 'delimiter' is in the buffer, but at most 'timeout'
+    // milliseconds from the first call.
+    WaitResult waitForDelimiter(CoRoutine& coRoutine, unsigned char delimiter, unsigned int timeout);
+
+    // Returns the milliseconds left until the current wait times out.
+    // (Timeouts must not exceed the largest 'int' for this to work.)
+    int getTimeLeft();
+
+    // Stop waiting.
+    void cancelWait();
+  };
+
+} // end of namespace coroutines
+
+#endif // __coroutines_rxbuffer_h__
@@ -0,0 +1,306 @@
+/*
+  Simple co-routine library for Arduino.
+  
+  Copyright 2011-2017 Martin Gamwell Dawids.
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+  For an overview of the functionality in this file,
+  please see the file "ShardedScheduler.h".
+*/
+
+#include <ShardedScheduler.h>
+
+#ifdef CoRoutinesHost
+
+#ifdef __linux__
+  #include <pthread.h>
+  #include <sched.h>
+#endif
+
+namespace coroutines {
+
+  ShardedScheduler::ShardedScheduler(unsigned char noShards, size_t maxCoRoutines, size_t queueSize)
+    : shards(0),
+      threads(0),
+      noShards(noShards == 0 ? 1 : noShards),
+      members(0),
+      maxMembers(maxCoRoutines),
+      noMembers(0),
+      running(false),
+      migrationCount(0)
+  {
+    shards = new ConcurrentScheduler*[this->noShards];
+    for (unsigned char i = 0; i != this->noShards; ++i)
+    {
+      shards[i] = new ConcurrentScheduler(queueSize);
+      shards[i]->setTimeWorkers(true);
+    }
+    threads = new std::thread[this->noShards];
+    members = new Member[maxMembers];
+  }
+
+  ShardedScheduler::~ShardedScheduler()
+  {
+    stop();
+    for (unsigned char i = 0; i != noShards; ++i)
+    {
+      delete shards[i];
+    }
+    delete[] shards;
+    delete[] threads;
+    delete[] members;
+  }
+
+  size_t ShardedScheduler::findMember(CoRoutine& coRoutine)
+  {
+    for (size_t i = 0; i != noMembers; ++i)
+    {
+      if (members[i].coRoutine == &coRoutine)
+      {
+        return i;
+      }
+    }
+    return noMembers;
+  }
+
+  void ShardedScheduler::runShard(unsigned char shard)
+  {
+    ConcurrentScheduler& scheduler = *shards[shard];
+    while (running.load(std::memory_order_relaxed))
+    {
+      scheduler.runOnce();
+      
+      // Sleep until the next co-routine is due. Adding, moving and
+      // removing co-routines post commands which wake the shard up, and
+      // so does 'stop()'.
+      scheduler.waitForWakeup();
+    }
+  }
+
+  bool ShardedScheduler::add(unsigned char shard, CoRoutine& coRoutine, unsigned char groups)
+  {
+    if (running.load(std::memory_order_relaxed))
+    {
+      return shards[shard]->addConcurrentlyAndWait(coRoutine, groups);
+    }
+    return shards[shard]->addCoRoutine(coRoutine, groups).isValid();
+  }
+
+  bool ShardedScheduler::migrate(Member& member, unsigned char shard)
+  {
+    // Remove before adding so the co-routine never runs on two threads.
+    CoRoutine& coRoutine = *member.coRoutine;
+    if (running.load(std::memory_order_relaxed))
+    {
+      shards[member.shard]->removeConcurrently(coRoutine);
+    }
+    else
+    {
+      shards[member.shard]->removeCoRoutine(coRoutine);
+    }
+    
+    if (!add(shard, coRoutine, member.groups))
+    {
+      // The new shard could not grow. Put it back where it came from.
+      add(member.shard, coRoutine, member.groups);
+      return false;
+    }
+    member.shard = shard;
+    return true;
+  }
+
+  bool ShardedScheduler::addCoRoutine(CoRoutine& coRoutine, unsigned char groups)
+  {
+    if (noMembers == maxMembers)
+    {
+      return false;
+    }
+
+    // Pick the shard with the fewest co-routines.
+    unsigned char shard = 0;
+    for (unsigned char i = 1; i != noShards; ++i)
+    {
+      if (getCoRoutineCount(i) < getCoRoutineCount(shard))
+      {
+        shard = i;
+      }
+    }
+    if (!add(shard, coRoutine, groups))
+    {
+      return false;
+    }
+
+    Member& member = members[noMembers++];
+    member.coRoutine = &coRoutine;
+    member.groups = groups;
+    member.shard = shard;
+    member.workerTime = coRoutine.getWorkerTime();
+    member.load = 0;
+    return true;
+  }
+
+  void ShardedScheduler::removeCoRoutine(CoRoutine& coRoutine)
+  {
+    const size_t index = findMember(coRoutine);
+    if (index == noMembers)
+    {
+      return;
+    }
+
+    if (running.load(std::memory_order_relaxed))
+    {
+      shards[members[index].shard]->removeConcurrently(coRoutine);
+    }
+    else
+    {
+      shards[members[index].shard]->removeCoRoutine(coRoutine);
+    }
+    members[index] = members[--noMembers];
+  }
+
+  void ShardedScheduler::start()
+  {
+    if (running.load(std::memory_order_relaxed))
+    {
+      return;
+    }
+    running.store(true, std::memory_order_relaxed);
+
+#ifdef __linux__
+    const unsigned int cores = std::thread::hardware_concurrency();
+#endif
+    for (unsigned char i = 0; i != noShards; ++i)
+    {
+      threads[i] = std::thread(&ShardedScheduler::runShard, this, i);
+      shards[i]->setDispatchThread(threads[i].get_id());
+#ifdef __linux__
+      // Pin the thread to a core of its own if there are enough cores.
+      cpu_set_t cpus;
+      CPU_ZERO(&cpus);
+      CPU_SET(i % (cores == 0 ? 1 : cores), &cpus);
+      pthread_setaffinity_np(threads[i].native_handle(), sizeof(cpus), &cpus);
+#endif
+    }
+  }
+
+  void ShardedScheduler::stop()
+  {
+    if (!running.load(std::memory_order_relaxed))
+    {
+      return;
+    }
+    running.store(false, std::memory_order_relaxed);
+    for (unsigned char i = 0; i != noShards; ++i)
+    {
+      shards[i]->wakeUp();
+      threads[i].join();
+      shards[i]->setDispatchThread(std::this_thread::get_id());
+    }
+  }
+
+  bool ShardedScheduler::rebalance()
+  {
+    // Time spent in workers per shard since the last call.
+    unsigned long loads[256] = { 0 };
+    for (size_t i = 0; i != noMembers; ++i)
+    {
+      Member& member = members[i];
+      const unsigned long workerTime = member.coRoutine->getWorkerTime();
+      member.load = workerTime - member.workerTime;
+      member.workerTime = workerTime;
+      loads[member.shard] += member.load;
+    }
+
+    unsigned char busiest = 0;
+    unsigned char idlest = 0;
+    for (unsigned char i = 1; i != noShards; ++i)
+    {
+      if (loads[i] > loads[busiest])
+      {
+        busiest = i;
+      }
+      if (loads[i] < loads[idlest])
+      {
+        idlest = i;
+      }
+    }
+    const unsigned long gap = loads[busiest] - loads[idlest];
+    if (gap <= loads[busiest] / 8)
+    {
+      // Close enough. Moving co-routines back and forth costs more.
+      return false;
+    }
+
+    // Moving a load below the gap narrows it. The best load to move is
+    // the one closest to half of the gap.
+    Member* best = 0;
+    unsigned long bestDistance = 0;
+    for (size_t i = 0; i != noMembers; ++i)
+    {
+      Member& member = members[i];
+      if (member.shard == busiest && member.load != 0 && member.load < gap)
+      {
+        const unsigned long distance = (2 * member.load > gap ? 2 * member.load - gap : gap - 2 * member.load);
+        if (best == 0 || distance < bestDistance)
+        {
+          best = &member;
+          bestDistance = distance;
+        }
+      }
+    }
+    if (best == 0)
+    {
+      return false;
+    }
+
+    if (!migrate(*best, idlest))
+    {
+      return false;
+    }
+    ++migrationCount;
+    return true;
+  }
+
+  unsigned char ShardedScheduler::getShardCount()
+  {
+    return noShards;
+  }
+
+  unsigned char ShardedScheduler::getShard(CoRoutine& coRoutine)
+  {
+    const size_t index = findMember(coRoutine);
+    return (index == noMembers ? noShards : members[index].shard);
+  }
+
+  size_t ShardedScheduler::getCoRoutineCount(unsigned char shard)
+  {
+    size_t count = 0;
+    for (size_t i = 0; i != noMembers; ++i)
+    {
+      if (members[i].shard == shard)
+      {
+        ++count;
+      }
+    }
+    return count;
+  }
+
+  unsigned long ShardedScheduler::getMigrationCount()
+  {
+    return migrationCount;
+  }
+
+} // end of namespace coroutines
+
+#endif // CoRoutinesHost
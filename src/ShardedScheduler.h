@@ -0,0 +1,151 @@
+/*
+  Simple co-routine library for Arduino.
+  
+  Copyright 2011-2017 Martin Gamwell Dawids.
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+  ShardedScheduler (host builds only)
+  -----------------------------------
+  A sharded scheduler spreads its co-routines over a number of shards.
+  Each shard is a ConcurrentScheduler run by a thread of its own. On Linux
+  the thread of shard 'i' is pinned to core 'i' (modulo the number of
+  cores).
+
+  The shards time the workers of their co-routines. Calling
+  ShardedScheduler::rebalance() periodically moves a co-routine from the
+  shard that spent the most time in workers since the last call to the
+  shard that spent the least, if they differ by more than an eighth and
+  moving the co-routine narrows the gap:
+
+    ShardedScheduler scheduler(4, 100); // 4 shards, up to 100 co-routines.
+    scheduler.addCoRoutine(coRoutine1);
+    ...
+    scheduler.start();
+    for (;;)
+    {
+      sleep(1);
+      scheduler.rebalance();
+    }
+
+  A co-routine being moved is removed from its old shard before it is
+  added to its new shard, so it never runs on two threads at once.
+
+  Each shard sleeps in ConcurrentScheduler::waitForWakeup() until its next
+  co-routine is due. Adding, moving and removing co-routines wakes the
+  shard concerned, and ShardedScheduler::addCoRoutine() waits for the
+  shard to add the co-routine so it can report whether it was added.
+
+  The methods of a ShardedScheduler must be called by one thread only,
+  which is not one of the threads of the shards. Co-routines run on
+  different threads, so co-routines of a sharded scheduler must only
+  interact with each other in thread-safe ways.
+ */
+
+#ifndef __coroutines_shardedscheduler_h__
+#define __coroutines_shardedscheduler_h__
+
+#include <ConcurrentScheduler.h>
+
+#ifdef CoRoutinesHost
+
+namespace coroutines {
+
+  // Co-routines spread over a number of schedulers run by threads of
+  // their own.
+  class ShardedScheduler
+  {
+  private:
+    // A co-routine of the scheduler.
+    struct Member
+    {
+      CoRoutine* coRoutine;
+      unsigned char groups;
+      unsigned char shard;
+      unsigned long workerTime;   // At the last rebalance.
+      unsigned long load;         // Worker time between the last rebalances.
+    };
+
+    ConcurrentScheduler** shards;
+    std::thread* threads;
+    const unsigned char noShards;
+    Member* members;
+    const size_t maxMembers;
+    size_t noMembers;
+    std::atomic<bool> running;
+    unsigned long migrationCount;
+
+    // Returns the index of the member 'coRoutine' or 'noMembers' if none.
+    size_t findMember(CoRoutine& coRoutine);
+
+    // The loop of the thread of 'shard'.
+    void runShard(unsigned char shard);
+
+    // Add 'coRoutine' to 'shard'. Returns 'false' if the shard could not
+    // add it.
+    bool add(unsigned char shard, CoRoutine& coRoutine, unsigned char groups);
+
+    // Move the co-routine of 'member' to 'shard'. Returns 'false' (and
+    // leaves it where it was) if 'shard' could not add it.
+    bool migrate(Member& member, unsigned char shard);
+
+  public:
+    // Create 'noShards' shards (at least 1) with room for 'maxCoRoutines'
+    // co-routines in total. 'queueSize' is the size of the command queue
+    // of each shard, see ConcurrentScheduler.
+    ShardedScheduler(unsigned char noShards, size_t maxCoRoutines, size_t queueSize = 64);
+
+    // Stops the threads of the shards.
+    virtual ~ShardedScheduler();
+
+    // Add 'coRoutine' to the shard with the fewest co-routines. While the
+    // shards run, returns when the shard has added it.
+    // Returns 'false' if there is no room for it or the shard could not
+    // add it.
+    bool addCoRoutine(CoRoutine& coRoutine, unsigned char groups = 0);
+
+    // Remove 'coRoutine'. Returns when it has been removed from its shard.
+    // If the co-routine is not member of this scheduler, nothing happens.
+    void removeCoRoutine(CoRoutine& coRoutine);
+
+    // Start a thread for each shard.
+    void start();
+
+    // Stop the threads of the shards. Returns when they have stopped.
+    void stop();
+
+    // Move a co-routine from the shard that has spent the most time in
+    // workers since the last call to the shard that has spent the least,
+    // unless they differ by an eighth or less.
+    // Returns 'true' iff a co-routine was moved.
+    bool rebalance();
+
+    // Returns the number of shards.
+    unsigned char getShardCount();
+
+    // Returns the shard of 'coRoutine' or 'getShardCount()' if the
+    // co-routine is not member of this scheduler.
+    unsigned char getShard(CoRoutine& coRoutine);
+
+    // Returns the number of co-routines in 'shard'.
+    size_t getCoRoutineCount(unsigned char shard);
+
+    // Returns the number of co-routines moved by 'rebalance()'.
+    unsigned long getMigrationCount();
+  };
+
+} // end of namespace coroutines
+
+#endif // CoRoutinesHost
+
+#endif // __coroutines_shardedscheduler_h__
@@ -0,0 +1,124 @@
+/*
+  Simple co-routine library for Arduino.
+  
+  Copyright 2011-2017 Martin Gamwell Dawids.
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+  For an overview of the functionality in this file,
+  please see the file "Simulation.h".
+*/
+
+#include <Simulation.h>
+
+#ifdef CoRoutinesHost
+
+namespace coroutines {
+
+  Simulation::Simulation(Scheduler& scheduler, unsigned long startTime)
+    : scheduler(scheduler),
+      time(startTime),
+      startTime(startTime),
+      busyTime(0),
+      invocations(0),
+      worstLateness(0),
+      deadlineMisses(0)
+  {
+    setClock(this);
+  }
+
+  Simulation::~Simulation()
+  {
+    setClock(0);
+  }
+
+  void Simulation::run(unsigned long duration)
+  {
+    const unsigned long end = time + duration;
+    while (time < end)
+    {
+      const unsigned long startOfRun = time;
+      const unsigned long invocationsBefore = invocations;
+      scheduler.runOnce();
+      
+      // Jump to the next wakeup.
+      const unsigned long wakeup = scheduler.getNextWakeup();
+      if (wakeup >= end)
+      {
+        time = end;
+      }
+      else if (wakeup > time)
+      {
+        time = wakeup;
+      }
+      else if (invocations == invocationsBefore || time == startOfRun)
+      {
+        // Still due although nothing ran, or due again without any time
+        // having passed. Make sure time passes.
+        ++time;
+      }
+      // Otherwise a co-routine became due while workers ran. Run it at
+      // the current time.
+    }
+  }
+
+  unsigned long Simulation::now()
+  {
+    return time;
+  }
+
+  void Simulation::workerRan(CoRoutine& coRoutine, unsigned long lateness)
+  {
+    ++invocations;
+    busyTime += coRoutine.getSimulatedRunTime();
+    time += coRoutine.getSimulatedRunTime();
+    
+    if (lateness > worstLateness)
+    {
+      worstLateness = lateness;
+    }
+    if (lateness > coRoutine.getSlack())
+    {
+      ++deadlineMisses;
+    }
+  }
+
+  unsigned long Simulation::getInvocationCount()
+  {
+    return invocations;
+  }
+
+  unsigned long Simulation::getBusyTime()
+  {
+    return busyTime;
+  }
+
+  float Simulation::getLoad()
+  {
+    const unsigned long elapsed = time - startTime;
+    return (elapsed == 0 ? 0.0f : (float) busyTime / elapsed);
+  }
+
+  unsigned long Simulation::getWorstLateness()
+  {
+    return worstLateness;
+  }
+
+  unsigned long Simulation::getDeadlineMisses()
+  {
+    return deadlineMisses;
+  }
+
+} // end of namespace coroutines
+
+#endif // CoRoutinesHost
@@ -0,0 +1,100 @@
+/*
+  Simple co-routine library for Arduino.
+  
+  Copyright 2011-2017 Martin Gamwell Dawids.
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+  Simulation (host builds only)
+  -----------------------------
+  A simulation runs a scheduler on a virtual clock. Instead of waiting for
+  the next co-routine to become due, the virtual clock jumps straight to
+  the next wakeup of the scheduler, so days of schedule can be run in
+  milliseconds. This is useful for predicting the load, the worst-case
+  lateness and the number of deadline misses of a set of co-routines
+  before deploying it.
+
+  The time spent in each worker can be modelled by calling
+  CoRoutine::setSimulatedRunTime(). Otherwise workers take no time.
+
+    Simulation simulation(scheduler);
+    simulation.run(24UL * 60 * 60 * 1000); // One day.
+    printf("Load: %f\n", simulation.getLoad());
+
+  Only one simulation can be running at a time. While it exists, all
+  co-routines use the virtual clock (see currentTime()).
+ */
+
+#ifndef __coroutines_simulation_h__
+#define __coroutines_simulation_h__
+
+#include <CoRoutines.h>
+
+#ifdef CoRoutinesHost
+
+namespace coroutines {
+
+  // Runs a scheduler on virtual time.
+  class Simulation : public Clock
+  {
+  private:
+    Scheduler& scheduler;
+    unsigned long time;
+    unsigned long startTime;
+    unsigned long busyTime;
+    unsigned long invocations;
+    unsigned long worstLateness;
+    unsigned long deadlineMisses;
+    
+  public:
+    // Create a simulation of 'scheduler' starting at virtual time 'startTime'.
+    // The virtual clock is used by all co-routines until the simulation
+    // is destroyed.
+    Simulation(Scheduler& scheduler, unsigned long startTime = 0);
+    virtual ~Simulation();
+
+    // Run the scheduler for 'duration' milliseconds of virtual time.
+    // Co-routines becoming due while workers run are run at the virtual
+    // time they become due. If a co-routine is due again without any time
+    // having passed, the virtual clock is advanced by one millisecond to
+    // make progress.
+    void run(unsigned long duration);
+
+    // Returns the current virtual time.
+    virtual unsigned long now();
+
+    // Accounts for the simulated run time of the worker.
+    virtual void workerRan(CoRoutine& coRoutine, unsigned long lateness);
+
+    // Returns the number of workers invoked.
+    unsigned long getInvocationCount();
+
+    // Returns the simulated time spent in workers.
+    unsigned long getBusyTime();
+
+    // Returns the fraction of virtual time spent in workers.
+    float getLoad();
+
+    // Returns the longest time a worker was invoked after its run time.
+    unsigned long getWorstLateness();
+
+    // Returns the number of times a worker was invoked later than its
+    // run time plus its slack.
+    unsigned long getDeadlineMisses();
+  };
+
+} // end of namespace coroutines
+
+#endif // CoRoutinesHost
+
+#endif // __coroutines_simulation_h__
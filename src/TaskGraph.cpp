@@ -0,0 +1,76 @@
+/*
+  Simple co-routine library for Arduino.
+  
+  Copyright 2011-2017 Martin Gamwell Dawids.
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+  For an overview of the functionality in this file,
+  please see the file "TaskGraph.h".
+*/
+
+#include <TaskGraph.h>
+
+namespace coroutines {
+
+  GraphCoRoutine::GraphCoRoutine(bool waitRelativeToWorkerExit)
+    : CoRoutine(waitRelativeToWorkerExit),
+      successors(0),
+      noPredecessors(0),
+      pendingPredecessors(0),
+      round(false)
+  { }
+
+  void GraphCoRoutine::complete()
+  {
+    for (Dependency* dependency = successors; dependency != 0; dependency = dependency->next)
+    {
+      GraphCoRoutine& successor = dependency->successor;
+      if (dependency->round == successor.round)
+      {
+        // Completed already in this round of the successor.
+        continue;
+      }
+      dependency->round = successor.round;
+      if (--successor.pendingPredecessors == 0)
+      {
+        // All inputs are ready. Start waiting for the next round.
+        successor.round = !successor.round;
+        successor.pendingPredecessors = successor.noPredecessors;
+        successor.awake();
+      }
+    }
+  }
+
+  unsigned char GraphCoRoutine::getPredecessorCount()
+  {
+    return noPredecessors;
+  }
+
+  unsigned char GraphCoRoutine::getPendingPredecessors()
+  {
+    return pendingPredecessors;
+  }
+
+  Dependency::Dependency(GraphCoRoutine& predecessor, GraphCoRoutine& successor)
+    : successor(successor),
+      next(predecessor.successors),
+      round(!successor.round)
+  {
+    predecessor.successors = this;
+    ++successor.noPredecessors;
+    ++successor.pendingPredecessors;
+    successor.suspend();
+  }
+
+} // end of namespace coroutines
@@ -0,0 +1,101 @@
+/*
+  Simple co-routine library for Arduino.
+  
+  Copyright 2011-2017 Martin Gamwell Dawids.
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+  Task graphs
+  -----------
+  Co-routines often form a chain of steps like "measure -> convert ->
+  publish" where each step must wait for the previous one. Instead of
+  letting each step poll a flag set by the previous one, derive the steps
+  from GraphCoRoutine and declare the dependencies between them:
+
+    Measure measure;
+    Convert convert;
+    Publish publish;
+    Dependency measureToConvert(measure, convert);
+    Dependency convertToPublish(convert, publish);
+
+  A co-routine with predecessors starts out suspended. Its worker is not
+  invoked until each of its predecessors has called
+  GraphCoRoutine::complete(), and then it is awakened. So the worker of a
+  step typically does its work, calls complete() to pass on to the next
+  steps and returns -1 to wait for its predecessors again.
+
+  Each co-routine counts how many of its predecessors have yet to complete
+  in the current round. A predecessor completing again before the round
+  has ended counts once, so a fast predecessor cannot stand in for a slow
+  one.
+ */
+
+#ifndef __coroutines_taskgraph_h__
+#define __coroutines_taskgraph_h__
+
+#include <CoRoutines.h>
+
+namespace coroutines {
+
+  class Dependency;
+
+  // A co-routine which can depend on other co-routines.
+  class GraphCoRoutine : public CoRoutine
+  {
+  private:
+    Dependency* successors;   // Linked list of edges to successors.
+    unsigned char noPredecessors;
+    unsigned char pendingPredecessors;
+    bool round;               // Flips whenever all predecessors have completed.
+    
+  protected:
+    // Call from the worker to signal that this co-routine has completed.
+    // Successors having no other predecessors pending are awakened.
+    void complete();
+    
+  public:
+    // Create a co-routine of a task graph.
+    // See 'CoRoutine' for the meaning of 'waitRelativeToWorkerExit'.
+    GraphCoRoutine(bool waitRelativeToWorkerExit = false);
+
+    // Returns the number of predecessors of this co-routine.
+    unsigned char getPredecessorCount();
+
+    // Returns the number of predecessors yet to complete before this
+    // co-routine is awakened.
+    unsigned char getPendingPredecessors();
+
+    friend class Dependency;
+  };
+
+
+  // An edge of a task graph: 'successor' depends on 'predecessor'.
+  // The dependency must live as long as the two co-routines.
+  class Dependency
+  {
+  private:
+    GraphCoRoutine& successor;
+    Dependency* next;         // Next edge from the same predecessor.
+    bool round;               // 'successor.round' when last completed.
+    
+  public:
+    // Make 'successor' wait for 'predecessor' to complete.
+    // The successor is suspended.
+    Dependency(GraphCoRoutine& predecessor, GraphCoRoutine& successor);
+
+    friend class GraphCoRoutine;
+  };
+
+} // end of namespace coroutines
+
+#endif // __coroutines_taskgraph_h__
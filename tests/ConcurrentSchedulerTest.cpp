@@ -0,0 +1,187 @@
+/*
+  Simple co-routine library for Arduino.
+
+  Copyright 2011-2017 Martin Gamwell Dawids.
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+  Tests of ConcurrentScheduler: commands posted by other threads while the
+  dispatch thread sleeps in waitForWakeup().
+ */
+
+#include <ConcurrentScheduler.h>
+#include "Test.h"
+
+using namespace coroutines;
+
+// Counts its runs and suspends itself.
+class Counter : public CoRoutine
+{
+public:
+  std::atomic<int> runs;
+
+  Counter() : runs(0) { }
+
+protected:
+  virtual int worker()
+  {
+    ++runs;
+    return -1;
+  }
+};
+
+// The dispatch thread of a scheduler, sleeping between runs.
+class Dispatcher
+{
+private:
+  ConcurrentScheduler& scheduler;
+  std::atomic<bool> stopping;
+  std::thread thread;
+
+  void run()
+  {
+    while (!stopping.load())
+    {
+      scheduler.runOnce();
+      scheduler.waitForWakeup();
+    }
+  }
+
+public:
+  Dispatcher(ConcurrentScheduler& scheduler)
+    : scheduler(scheduler),
+      stopping(false),
+      thread(&Dispatcher::run, this)
+  {
+    scheduler.setDispatchThread(thread.get_id());
+  }
+
+  ~Dispatcher()
+  {
+    stopping.store(true);
+    scheduler.wakeUp();
+    thread.join();
+  }
+};
+
+static void testBeforeFirstRun()
+{
+  // The creating thread is the dispatch thread until 'runOnce()'.
+  ConcurrentScheduler scheduler;
+  Counter counter;
+  scheduler.addCoRoutine(counter);
+  scheduler.removeConcurrently(counter);
+  CHECK(scheduler.addConcurrentlyAndWait(counter));
+  scheduler.removeConcurrently(counter);
+}
+
+static void testWhileSleeping()
+{
+  ConcurrentScheduler scheduler;
+  Dispatcher dispatcher(scheduler);
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+  // Each command wakes the sleeping dispatch thread.
+  Counter counter;
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  CHECK(scheduler.addConcurrently(counter));
+  CHECK(waitUntil([&] { return counter.runs.load() == 1; }));
+  CHECK(millisSince(start) < 100);
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  CHECK(scheduler.awakeConcurrently(counter));
+  CHECK(waitUntil([&] { return counter.runs.load() == 2; }));
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  start = std::chrono::steady_clock::now();
+  scheduler.removeConcurrently(counter);
+  CHECK(millisSince(start) < 100);
+
+  // An add the scheduler rejects is reported.
+  Counter other;
+  Scheduler otherScheduler;
+  otherScheduler.addCoRoutine(other);
+  CHECK(!scheduler.addConcurrentlyAndWait(other));
+  counter.awake();
+  CHECK(scheduler.addConcurrentlyAndWait(counter));
+  CHECK(waitUntil([&] { return counter.runs.load() == 3; }));
+  scheduler.removeConcurrently(counter);
+}
+
+static void testFullQueue()
+{
+  // Nobody applies the commands.
+  ConcurrentScheduler scheduler(2);
+  Counter counters[3];
+  CHECK(scheduler.addConcurrently(counters[0]));
+  CHECK(scheduler.addConcurrently(counters[1]));
+  CHECK(!scheduler.addConcurrently(counters[2]));
+  scheduler.runOnce();
+  CHECK(counters[0].runs.load() == 1 && counters[1].runs.load() == 1);
+  scheduler.removeCoRoutine(counters[0]);
+  scheduler.removeCoRoutine(counters[1]);
+}
+
+static void testManyProducers()
+{
+  const int noProducers = 4;
+  const int noCoRoutines = 50;
+  ConcurrentScheduler scheduler(8);
+  Dispatcher dispatcher(scheduler);
+  static Counter counters[noProducers][noCoRoutines];
+
+  std::thread producers[noProducers];
+  for (int p = 0; p != noProducers; ++p)
+  {
+    producers[p] = std::thread([&scheduler, p]
+    {
+      for (int i = 0; i != noCoRoutines; ++i)
+      {
+        Counter& counter = counters[p][i];
+        while (!scheduler.addConcurrently(counter))
+        {
+          std::this_thread::yield();
+        }
+        waitUntil([&] { return counter.runs.load() == 1; });
+        while (!scheduler.awakeConcurrently(counter))
+        {
+          std::this_thread::yield();
+        }
+        waitUntil([&] { return counter.runs.load() == 2; });
+        scheduler.removeConcurrently(counter);
+      }
+    });
+  }
+  for (int p = 0; p != noProducers; ++p)
+  {
+    producers[p].join();
+  }
+
+  // Each co-routine ran when added and when awakened.
+  for (int p = 0; p != noProducers; ++p)
+  {
+    for (int i = 0; i != noCoRoutines; ++i)
+    {
+      CHECK(counters[p][i].runs.load() == 2);
+    }
+  }
+}
+
+int main()
+{
+  testBeforeFirstRun();
+  testWhileSleeping();
+  testFullQueue();
+  testManyProducers();
+  return testResult("ConcurrentSchedulerTest");
+}
@@ -0,0 +1,192 @@
+/*
+  Simple co-routine library for Arduino.
+
+  Copyright 2011-2017 Martin Gamwell Dawids.
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+  Tests of EventLoop: waiting for a pipe with and without a timeout, and
+  running a ConcurrentScheduler woken by commands from other threads.
+ */
+
+#include <ConcurrentScheduler.h>
+#include <EventLoop.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "Test.h"
+
+using namespace coroutines;
+
+// Reads a pipe, waiting for it with a timeout.
+class Reader : public CoRoutine
+{
+private:
+  EventLoop& loop;
+  int fd;
+  int timeout;
+
+public:
+  std::atomic<int> bytes;
+  std::atomic<int> waits;
+  std::chrono::steady_clock::time_point readTime;   // Of the last read.
+
+  Reader(EventLoop& loop, int fd, int timeout)
+    : loop(loop), fd(fd), timeout(timeout), bytes(0), waits(0)
+  { }
+
+protected:
+  virtual int worker()
+  {
+    char buffer[16];
+    const ssize_t n = read(fd, buffer, sizeof(buffer));
+    if (n > 0)
+    {
+      bytes += (int) n;
+      readTime = std::chrono::steady_clock::now();
+      return -1;
+    }
+    if (n < 0 && errno == EAGAIN)
+    {
+      // The first run or the wait timed out.
+      loop.waitReadable(fd, *this);
+      ++waits;
+    }
+    return timeout;
+  }
+};
+
+// Counts its runs and suspends itself.
+class Counter : public CoRoutine
+{
+public:
+  std::atomic<int> runs;
+
+  Counter() : runs(0) { }
+
+protected:
+  virtual int worker()
+  {
+    ++runs;
+    return -1;
+  }
+};
+
+// Stops the loop when awakened.
+class Stopper : public CoRoutine
+{
+private:
+  EventLoop& loop;
+  bool started;
+
+public:
+  Stopper(EventLoop& loop) : loop(loop), started(false) { }
+
+protected:
+  virtual int worker()
+  {
+    if (started)
+    {
+      loop.stop();
+    }
+    started = true;
+    return -1;
+  }
+};
+
+static void testPipe()
+{
+  int fds[2];
+  CHECK(pipe2(fds, O_NONBLOCK) == 0);
+  Scheduler scheduler;
+  EventLoop loop(scheduler);
+  CHECK(loop.isValid());
+  Reader reader(loop, fds[0], -1);
+  scheduler.addCoRoutine(reader);
+
+  // The loop sleeps until the pipe becomes readable, not for the 50 ms
+  // allowed.
+  std::thread writer([&]
+  {
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    CHECK(write(fds[1], "hello", 5) == 5);
+  });
+  const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  while (reader.bytes.load() == 0 && millisSince(start) < 1000)
+  {
+    loop.runOnce(50);
+  }
+  writer.join();
+  CHECK(reader.bytes.load() == 5);
+  CHECK(reader.readTime - start < std::chrono::milliseconds(45));
+
+  loop.cancelWait(fds[0]);
+  close(fds[0]);
+  close(fds[1]);
+}
+
+static void testTimeout()
+{
+  int fds[2];
+  CHECK(pipe2(fds, O_NONBLOCK) == 0);
+  Scheduler scheduler;
+  EventLoop loop(scheduler);
+  Reader reader(loop, fds[0], 30);
+  scheduler.addCoRoutine(reader);
+
+  // Nothing is written, so every 30 ms the wait times out.
+  const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  while (millisSince(start) < 100)
+  {
+    loop.runOnce(1000);
+  }
+  CHECK(reader.bytes.load() == 0);
+  CHECK(reader.waits.load() >= 3 && reader.waits.load() <= 5);
+
+  loop.cancelWait(fds[0]);
+  close(fds[0]);
+  close(fds[1]);
+}
+
+static void testConcurrentScheduler()
+{
+  ConcurrentScheduler scheduler;
+  EventLoop loop(scheduler);
+  CHECK(loop.isValid());
+  Stopper stopper(loop);
+  scheduler.addCoRoutine(stopper);
+  std::thread dispatcher([&]
+  {
+    loop.run();
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+  // A command posted wakes the loop through its 'eventfd'.
+  Counter counter;
+  const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  CHECK(scheduler.addConcurrently(counter));
+  CHECK(waitUntil([&] { return counter.runs.load() == 1; }));
+  CHECK(millisSince(start) < 100);
+  scheduler.removeConcurrently(counter);
+
+  CHECK(scheduler.awakeConcurrently(stopper));
+  dispatcher.join();
+}
+
+int main()
+{
+  testPipe();
+  testTimeout();
+  testConcurrentScheduler();
+  return testResult("EventLoopTest");
+}
@@ -0,0 +1,161 @@
+/*
+  Simple co-routine library for Arduino.
+
+  Copyright 2011-2017 Martin Gamwell Dawids.
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+  Tests of OffloadPool with each way of learning of completed functions:
+  polling, a ConcurrentScheduler and an EventLoop.
+ */
+
+#include <ConcurrentScheduler.h>
+#include <EventLoop.h>
+#include <OffloadPool.h>
+#include "Test.h"
+
+using namespace coroutines;
+
+// A blocking function taking 30 ms.
+static void sleep30(void* argument)
+{
+  std::this_thread::sleep_for(std::chrono::milliseconds(30));
+  ++*(std::atomic<int>*) argument;
+}
+
+// Offloads 'sleep30()' once and records when it was awakened.
+class User : public CoRoutine
+{
+private:
+  OffloadPool& pool;
+  bool offloaded;
+  std::chrono::steady_clock::time_point start;
+
+public:
+  std::atomic<int> calls;
+  std::atomic<bool> done;
+  double time;              // Milliseconds until awakened.
+
+  User(OffloadPool& pool) : pool(pool), offloaded(false), calls(0), done(false), time(0) { }
+
+protected:
+  virtual int worker()
+  {
+    if (!offloaded)
+    {
+      start = std::chrono::steady_clock::now();
+      if (!pool.offload(*this, sleep30, &calls))
+      {
+        return 1;
+      }
+      offloaded = true;
+      return -1;
+    }
+    time = millisSince(start);
+    done.store(true);
+    return -1;
+  }
+};
+
+// Does nothing. Awakened by a pool.
+class Idle : public CoRoutine
+{
+protected:
+  virtual int worker()
+  {
+    return -1;
+  }
+};
+
+static void testPolling()
+{
+  Scheduler scheduler;
+  OffloadPool pool(1, 4);
+  scheduler.addCoRoutine(pool);
+  User user(pool);
+  scheduler.addCoRoutine(user);
+
+  const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  while (!user.done.load() && millisSince(start) < 1000)
+  {
+    scheduler.runOnce();
+    std::this_thread::sleep_for(std::chrono::milliseconds(scheduler.getTimeToNextWakeup(100)));
+  }
+  CHECK(user.done.load());
+  CHECK(user.calls.load() == 1);
+  CHECK(user.time >= 30 && user.time < 100);
+  CHECK(pool.getJobCount() == 0);
+}
+
+static void testConcurrentScheduler()
+{
+  ConcurrentScheduler scheduler;
+  OffloadPool pool(scheduler, 1, 4);
+  scheduler.addCoRoutine(pool);
+  User user(pool);
+  scheduler.addCoRoutine(user);
+
+  // The pool awakes itself concurrently, ending the wait.
+  const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  while (!user.done.load() && millisSince(start) < 1000)
+  {
+    scheduler.runOnce();
+    scheduler.waitForWakeup(1000);
+  }
+  CHECK(user.done.load());
+  CHECK(user.time >= 30 && user.time < 100);
+}
+
+static void testEventLoop()
+{
+  Scheduler scheduler;
+  EventLoop loop(scheduler);
+  OffloadPool pool(loop, 1, 4);
+  scheduler.addCoRoutine(pool);
+  User user(pool);
+  scheduler.addCoRoutine(user);
+
+  const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  while (!user.done.load() && millisSince(start) < 1000)
+  {
+    loop.runOnce(1000);
+  }
+  CHECK(user.done.load());
+  CHECK(user.time >= 30 && user.time < 100);
+}
+
+static void testFull()
+{
+  // The co-routines and the argument outlive the pool, whose destructor
+  // waits for the functions running.
+  std::atomic<int> calls(0);
+  Idle first;
+  Idle second;
+  Idle third;
+  Scheduler scheduler;
+  OffloadPool pool(2, 2);
+  scheduler.addCoRoutine(pool);
+  CHECK(pool.offload(first, sleep30, &calls));
+  CHECK(pool.offload(second, sleep30, &calls));
+  CHECK(!pool.offload(third, sleep30, &calls));
+  CHECK(pool.getJobCount() == 2);
+}
+
+int main()
+{
+  testPolling();
+  testConcurrentScheduler();
+  testEventLoop();
+  testFull();
+  return testResult("OffloadPoolTest");
+}
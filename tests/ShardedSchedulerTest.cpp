@@ -0,0 +1,132 @@
+/*
+  Simple co-routine library for Arduino.
+
+  Copyright 2011-2017 Martin Gamwell Dawids.
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+  Tests of ShardedScheduler: adding and removing co-routines while the
+  shards sleep, stopping idle shards and moving load between shards.
+ */
+
+#include <ShardedScheduler.h>
+#include "Test.h"
+
+using namespace coroutines;
+
+// Spins for 'spin' microseconds every 'period' milliseconds. Notices if
+// it ever runs on two threads at once.
+class Spinner : public CoRoutine
+{
+private:
+  const int spin;
+  const int period;
+  std::atomic<bool> inside;
+
+public:
+  std::atomic<int> runs;
+  std::atomic<int> overlaps;
+
+  Spinner(int spin = 0, int period = 1)
+    : spin(spin), period(period), inside(false), runs(0), overlaps(0)
+  { }
+
+protected:
+  virtual int worker()
+  {
+    if (inside.exchange(true))
+    {
+      ++overlaps;
+    }
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    while (millisSince(start) * 1000 < spin)
+    {
+    }
+    ++runs;
+    inside.store(false);
+    return period;
+  }
+};
+
+static void testIdleShards()
+{
+  ShardedScheduler scheduler(2, 8);
+  Spinner slow(0, 100000);
+  CHECK(scheduler.addCoRoutine(slow));
+  scheduler.start();
+  CHECK(waitUntil([&] { return slow.runs.load() == 1; }));
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+  // The shards sleep until a command wakes them.
+  Spinner fresh(0, 100000);
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  CHECK(scheduler.addCoRoutine(fresh));
+  CHECK(waitUntil([&] { return fresh.runs.load() == 1; }));
+  CHECK(millisSince(start) < 100);
+
+  // An add the shard rejects is reported.
+  Spinner owned(0, 100000);
+  Scheduler other;
+  other.addCoRoutine(owned);
+  CHECK(!scheduler.addCoRoutine(owned));
+  CHECK(scheduler.getShard(owned) == scheduler.getShardCount());
+  CHECK(scheduler.getCoRoutineCount(0) + scheduler.getCoRoutineCount(1) == 2);
+
+  start = std::chrono::steady_clock::now();
+  scheduler.removeCoRoutine(fresh);
+  CHECK(millisSince(start) < 100);
+
+  start = std::chrono::steady_clock::now();
+  scheduler.stop();
+  CHECK(millisSince(start) < 100);
+  other.removeCoRoutine(owned);
+}
+
+static void testRebalance()
+{
+  ShardedScheduler scheduler(2, 16);
+  Spinner heavy1(400, 1);
+  Spinner heavy2(400, 1);
+  Spinner light[6];
+
+  // Both heavy co-routines start on shard 0.
+  CHECK(scheduler.addCoRoutine(heavy1));
+  CHECK(scheduler.addCoRoutine(light[0]));
+  CHECK(scheduler.addCoRoutine(heavy2));
+  for (int i = 1; i != 6; ++i)
+  {
+    CHECK(scheduler.addCoRoutine(light[i]));
+  }
+  CHECK(scheduler.getShard(heavy1) == scheduler.getShard(heavy2));
+
+  scheduler.start();
+  for (int i = 0; i != 5; ++i)
+  {
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    scheduler.rebalance();
+  }
+  CHECK(scheduler.getShard(heavy1) != scheduler.getShard(heavy2));
+  CHECK(scheduler.getMigrationCount() >= 1);
+
+  scheduler.removeCoRoutine(light[0]);
+  scheduler.stop();
+  CHECK(heavy1.overlaps.load() == 0 && heavy2.overlaps.load() == 0);
+  CHECK(heavy1.runs.load() > 100 && heavy2.runs.load() > 100);
+}
+
+int main()
+{
+  testIdleShards();
+  testRebalance();
+  return testResult("ShardedSchedulerTest");
+}
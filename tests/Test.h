@@ -0,0 +1,75 @@
+/*
+  Simple co-routine library for Arduino.
+
+  Copyright 2011-2017 Martin Gamwell Dawids.
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+  Test helpers (host builds only)
+  -------------------------------
+  Each test program calls CHECK() for what it expects and returns
+  'testResult()' from 'main()', which is non-zero if any check failed.
+ */
+
+#ifndef __coroutines_test_h__
+#define __coroutines_test_h__
+
+#include <chrono>
+#include <stdio.h>
+#include <thread>
+
+// Count and report a failed check.
+#define CHECK(condition) testCheck((condition), #condition, __FILE__, __LINE__)
+
+static int testFailures = 0;
+
+static void testCheck(bool passed, const char* condition, const char* file, int line)
+{
+  if (!passed)
+  {
+    printf("%s:%d: check failed: %s\n", file, line, condition);
+    ++testFailures;
+  }
+}
+
+// Returns the exit code of the test program.
+static int testResult(const char* name)
+{
+  printf("%s: %s\n", name, testFailures == 0 ? "passed" : "FAILED");
+  return (testFailures == 0 ? 0 : 1);
+}
+
+// Returns the milliseconds passed since 'start'.
+static double millisSince(std::chrono::steady_clock::time_point start)
+{
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Wait until 'condition()' holds, for at most 'timeout' milliseconds.
+// Returns 'false' on timeout.
+template <class Condition>
+static bool waitUntil(Condition condition, unsigned int timeout = 1000)
+{
+  const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  while (!condition())
+  {
+    if (millisSince(start) > timeout)
+    {
+      return false;
+    }
+    std::this_thread::sleep_for(std::chrono::microseconds(100));
+  }
+  return true;
+}
+
+#endif // __coroutines_test_h__